@@ -0,0 +1,141 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+// Writer/reader stress run of ConcurrentOctree, meant to be built with -fsanitize=address or -fsanitize=thread.
+// One writer inserts and deletes points while the readers query snapshots, and check that the points the writer
+// never deletes are always found. Usage: octree_concurrent_stress [rounds] [readers]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+#include "concurrent_octree.h"
+
+using namespace cv;
+
+static std::atomic<int> failures(0);
+
+static void fail(const char* what, const Point3f& point)
+{
+    if(failures++ == 0)
+    {
+        std::printf("FAILED: %s at (%f, %f, %f)\n", what, point.x, point.y, point.z);
+    }
+}
+
+//! Query snapshots until the writer is done, around points that are never deleted.
+static void readerLoop(const ConcurrentOctree& tree, const std::vector<Point3f>& kept, const std::atomic<bool>& done,
+                       unsigned seed, size_t& queries)
+{
+    const float radius = 0.05f;
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> pick(0, kept.size() - 1);
+    std::vector<Point3f> found;
+    std::vector<float> squareDists;
+    while(!done.load())
+    {
+        const Point3f& point = kept[pick(rng)];
+        {
+            ConcurrentOctree::Snapshot snapshot = tree.snapshot();
+            const Octree& version = snapshot.tree();
+            if(version.index(point) == nullptr)
+            {
+                fail("index", point);
+            }
+            version.KNNSearch(point, 1, found, squareDists);
+            if(found.size() != 1 || squareDists[0] != 0)
+            {
+                fail("KNNSearch", point);
+            }
+            version.radiusNNSearch(point, radius, found, squareDists);
+            for(size_t i = 0; i < squareDists.size(); i++)
+            {
+                if(squareDists[i] > radius * radius || (i > 0 && squareDists[i] < squareDists[i - 1]))
+                {
+                    fail("radiusNNSearch", point);
+                }
+            }
+            if(squareDists.empty() || squareDists[0] != 0)
+            {
+                fail("radiusNNSearch", point);
+            }
+        }
+
+        // The helpers pin their own snapshot.
+        tree.KNNSearch(point, 1, found, squareDists);
+        if(found.size() != 1 || squareDists[0] != 0)
+        {
+            fail("ConcurrentOctree::KNNSearch", point);
+        }
+        queries++;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int rounds = argc > 1 ? std::atoi(argv[1]) : 2000;
+    const int readerNum = argc > 2 ? std::atoi(argv[2]) : 4;
+    const int keptNum = 2000, batchSize = 64;
+
+    // The kept points are in x < 0 and the inserted and deleted ones in x > 0, so that no deletion removes a kept
+    // point. The leaves point to the points, which outlive the tree.
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> coord(-0.99f, 0.99f), side(0.01f, 0.99f);
+    std::vector<Point3f> kept(keptNum);
+    for(Point3f& point : kept)
+    {
+        point = Point3f(-side(rng), coord(rng), coord(rng));
+    }
+    std::vector<Point3f> changed((size_t)rounds * batchSize);
+    for(Point3f& point : changed)
+    {
+        point = Point3f(side(rng), coord(rng), coord(rng));
+    }
+
+    ConcurrentOctree tree(8, 2.0, Point3f(-1, -1, -1));
+    tree.insertPoints(kept);
+
+    std::atomic<bool> done(false);
+    std::vector<size_t> queries(readerNum, 0);
+    std::vector<std::thread> readers;
+    for(int reader = 0; reader < readerNum; reader++)
+    {
+        readers.emplace_back(readerLoop, std::cref(tree), std::cref(kept), std::cref(done), 100u + reader,
+                             std::ref(queries[reader]));
+    }
+
+    // Every round inserts a batch, a few single points, and deletes the batch of two rounds ago.
+    for(int round = 0; round < rounds; round++)
+    {
+        Point3f* batch = &changed[(size_t)round * batchSize];
+        tree.insertPoints(batch, batchSize / 2);
+        for(int i = batchSize / 2; i < batchSize; i++)
+        {
+            tree.insertPoint(batch[i]);
+        }
+        if(round >= 2)
+        {
+            const Point3f* old = &changed[(size_t)(round - 2) * batchSize];
+            for(int i = 0; i < batchSize; i++)
+            {
+                if(!tree.deletePoint(old[i]))
+                {
+                    fail("deletePoint", old[i]);
+                }
+            }
+        }
+    }
+    done.store(true);
+
+    size_t queryNum = 0;
+    for(int reader = 0; reader < readerNum; reader++)
+    {
+        readers[reader].join();
+        queryNum += queries[reader];
+    }
+    std::printf("%d rounds, %d readers, %zu queries, %d failures\n", rounds, readerNum, queryNum, failures.load());
+    return failures.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,450 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+// Google Benchmark suite of Octree. Every benchmark takes the point count, the distribution (0 uniform, 1 bunny,
+// 2 LiDAR-like) and maxDepth as arguments, the builds also take the build flags. Select a subset with
+// --benchmark_filter, for example --benchmark_filter='BM_KNNSearch/n:100000/.*'.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "octree.h"
+#include "ply_reader.h"
+
+#ifndef OCTREE_DATA_DIR
+#define OCTREE_DATA_DIR "../data"
+#endif
+
+// The heap usage of the whole process, to report the peak memory of the builds.
+static std::atomic<size_t> liveBytes(0);
+static std::atomic<size_t> peakBytes(0);
+
+//! The size is stored in front of every block, the header keeps the alignment of malloc.
+static const size_t allocHeader = 16;
+
+static void* countedAlloc(size_t size)
+{
+    void* block = std::malloc(size + allocHeader);
+    if(block == nullptr)
+    {
+        return nullptr;
+    }
+    *(size_t*)block = size;
+    size_t live = liveBytes.fetch_add(size) + size;
+    size_t peak = peakBytes.load();
+    while(live > peak && !peakBytes.compare_exchange_weak(peak, live))
+    {
+    }
+    return (char*)block + allocHeader;
+}
+
+static void countedFree(void* ptr)
+{
+    if(ptr == nullptr)
+    {
+        return;
+    }
+    void* block = (char*)ptr - allocHeader;
+    liveBytes.fetch_sub(*(size_t*)block);
+    std::free(block);
+}
+
+void* operator new(size_t size)
+{
+    void* ptr = countedAlloc(size);
+    if(ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept { countedFree(ptr); }
+void operator delete[](void* ptr) noexcept { countedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { countedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { countedFree(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { countedFree(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { countedFree(ptr); }
+
+using namespace cv;
+
+enum PointDistribution
+{
+    DISTRIBUTION_UNIFORM = 0,
+    DISTRIBUTION_BUNNY = 1,
+    DISTRIBUTION_LIDAR = 2
+};
+
+//! Uniform in a cube of size 10.
+static void uniformCloud(size_t pointNum, std::mt19937& rng, std::vector<Point3f>& cloud)
+{
+    std::uniform_real_distribution<float> coordinate(0.f, 10.f);
+    for(size_t i = 0; i < pointNum; i++)
+    {
+        cloud.push_back(Point3f(coordinate(rng), coordinate(rng), coordinate(rng)));
+    }
+}
+
+//! The bunny of the demo, resampled to pointNum points by jittering random vertices.
+static void bunnyCloud(size_t pointNum, std::mt19937& rng, std::vector<Point3f>& cloud)
+{
+    std::vector<Point3f> vertices;
+    PLYReader reader;
+    if(!reader.open(OCTREE_DATA_DIR "/bunny.ply") || !reader.read(vertices) || vertices.empty())
+    {
+        CV_Error(Error::StsError, "can't read " OCTREE_DATA_DIR "/bunny.ply");
+    }
+
+    std::uniform_int_distribution<size_t> pick(0, vertices.size() - 1);
+    std::normal_distribution<float> jitter(0.f, 0.002f);
+    for(size_t i = 0; i < pointNum; i++)
+    {
+        const Point3f& v = vertices[pick(rng)];
+        cloud.push_back(Point3f(v.x + jitter(rng), v.y + jitter(rng), v.z + jitter(rng)) * 5.f);
+    }
+}
+
+/** A spinning 64 beam sensor driving along x: rings on the ground, vertical stripes on the surrounding walls, and
+ * a density that falls with the distance to the sensor.
+ */
+static void lidarCloud(size_t pointNum, std::mt19937& rng, std::vector<Point3f>& cloud)
+{
+    const int beamNum = 64;
+    const int azimuthNum = 2048;
+    const float sensorHeight = 1.7f;
+    const float pi = 3.14159265f;
+    std::normal_distribution<float> rangeNoise(0.f, 0.02f);
+    for(size_t i = 0; i < pointNum; i++)
+    {
+        size_t sweep = i / (beamNum * azimuthNum);
+        int beam = (int)(i % beamNum);
+        int step = (int)((i / beamNum) % azimuthNum);
+        float elevation = (-25.f + 28.f * beam / (beamNum - 1)) * pi / 180.f;
+        float azimuth = 2.f * pi * step / azimuthNum;
+        Point3f direction(std::cos(elevation) * std::cos(azimuth), std::cos(elevation) * std::sin(azimuth),
+                          std::sin(elevation));
+
+        // The walls get closer and farther with the azimuth, the ground stops the downward beams first.
+        float wallRange = (10.f + 30.f * std::fabs(std::sin(3.f * azimuth))) / std::cos(elevation);
+        float range = direction.z < 0 ? std::min(wallRange, -sensorHeight / direction.z) : wallRange;
+        range += rangeNoise(rng);
+        Point3f sensor(0.5f * sweep, 0.f, sensorHeight);
+        cloud.push_back(sensor + direction * range);
+    }
+}
+
+//! The point cloud of the arguments, the last one is kept for the following benchmarks.
+static const std::vector<Point3f>& pointCloud(size_t pointNum, int distribution)
+{
+    static std::vector<Point3f> cloud;
+    static size_t cachedNum = 0;
+    static int cachedDistribution = -1;
+    if(cachedNum != pointNum || cachedDistribution != distribution)
+    {
+        std::vector<Point3f>().swap(cloud);
+        cloud.reserve(pointNum);
+        std::mt19937 rng(12345);
+        if(distribution == DISTRIBUTION_BUNNY)
+        {
+            bunnyCloud(pointNum, rng, cloud);
+        }
+        else if(distribution == DISTRIBUTION_LIDAR)
+        {
+            lidarCloud(pointNum, rng, cloud);
+        }
+        else
+        {
+            uniformCloud(pointNum, rng, cloud);
+        }
+        cachedNum = pointNum;
+        cachedDistribution = distribution;
+    }
+    return cloud;
+}
+
+//! The tree of the arguments over pointCloud(), the last one is kept for the following benchmarks.
+static Octree& pointCloudTree(size_t pointNum, int distribution, int maxDepth)
+{
+    static Ptr<Octree> tree;
+    static std::vector<Point3f> treeCloud;
+    static size_t cachedNum = 0;
+    static int cachedDistribution = -1;
+    static int cachedDepth = -1;
+    if(cachedNum != pointNum || cachedDistribution != distribution || cachedDepth != maxDepth)
+    {
+        // The leaves point to the cloud, which must not move under them.
+        tree.reset();
+        treeCloud = pointCloud(pointNum, distribution);
+        tree = makePtr<Octree>(maxDepth);
+        tree->convertFromPointCloud(treeCloud, OCTREE_BUILD_PARALLEL);
+        cachedNum = pointNum;
+        cachedDistribution = distribution;
+        cachedDepth = maxDepth;
+    }
+    return *tree;
+}
+
+//! Query points near the cloud: cloud points moved by about the spacing of the points.
+static std::vector<Point3f> queryPoints(const std::vector<Point3f>& cloud, size_t queryNum, float jitterSize)
+{
+    std::mt19937 rng(54321);
+    std::uniform_int_distribution<size_t> pick(0, cloud.size() - 1);
+    std::uniform_real_distribution<float> jitter(-jitterSize, jitterSize);
+    std::vector<Point3f> queries(queryNum);
+    for(Point3f& query : queries)
+    {
+        query = cloud[pick(rng)] + Point3f(jitter(rng), jitter(rng), jitter(rng));
+    }
+    return queries;
+}
+
+//! The side of the bounding box of the cloud divided by the cube root of the point count.
+static float pointSpacing(const Octree& tree, size_t pointNum)
+{
+    return (float)(tree.size / std::cbrt((double)pointNum));
+}
+
+//! Report the p50, p90 and p99 of the latencies of the single queries in nanoseconds.
+static void reportLatency(benchmark::State& state, std::vector<double>& latencies)
+{
+    if(latencies.empty())
+    {
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p)
+    {
+        return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+    };
+    state.counters["p50_ns"] = percentile(0.5);
+    state.counters["p90_ns"] = percentile(0.9);
+    state.counters["p99_ns"] = percentile(0.99);
+}
+
+template<typename Query>
+static void timeQueries(benchmark::State& state, const std::vector<Point3f>& queries, Query&& query)
+{
+    std::vector<double> latencies;
+    latencies.reserve(std::min<size_t>(queries.size(), 1 << 20));
+    size_t i = 0;
+    for(auto _ : state)
+    {
+        auto start = std::chrono::steady_clock::now();
+        query(queries[i]);
+        auto stop = std::chrono::steady_clock::now();
+        if(latencies.size() < latencies.capacity())
+        {
+            latencies.push_back(std::chrono::duration<double, std::nano>(stop - start).count());
+        }
+        i = i + 1 == queries.size() ? 0 : i + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportLatency(state, latencies);
+}
+
+static void BM_ConvertFromPointCloud(benchmark::State& state)
+{
+    std::vector<Point3f> cloud = pointCloud((size_t)state.range(0), (int)state.range(1));
+    const int maxDepth = (int)state.range(2);
+    const int flags = (int)state.range(3);
+    size_t treeBytes = 0;
+    size_t buildPeakBytes = 0;
+    for(auto _ : state)
+    {
+        Octree tree(maxDepth);
+        size_t before = liveBytes.load();
+        peakBytes.store(before);
+        tree.convertFromPointCloud(cloud, flags);
+        treeBytes = liveBytes.load() - before;
+        buildPeakBytes = peakBytes.load() - before;
+        benchmark::DoNotOptimize(tree.rootNode);
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)cloud.size());
+    state.counters["tree_bytes"] = (double)treeBytes;
+    state.counters["peak_bytes"] = (double)buildPeakBytes;
+    state.counters["bytes_per_point"] = (double)treeBytes / (double)cloud.size();
+}
+
+static void BM_Index(benchmark::State& state)
+{
+    const size_t pointNum = (size_t)state.range(0);
+    Octree& tree = pointCloudTree(pointNum, (int)state.range(1), (int)state.range(2));
+    std::vector<Point3f> queries = queryPoints(pointCloud(pointNum, (int)state.range(1)), 1 << 16, 0.f);
+    timeQueries(state, queries, [&tree](const Point3f& query)
+    {
+        benchmark::DoNotOptimize(tree.index(query));
+    });
+}
+
+static void BM_KNNSearch(benchmark::State& state)
+{
+    const size_t pointNum = (size_t)state.range(0);
+    const Octree& tree = pointCloudTree(pointNum, (int)state.range(1), (int)state.range(2));
+    std::vector<Point3f> queries = queryPoints(pointCloud(pointNum, (int)state.range(1)), 1 << 16,
+                                               pointSpacing(tree, pointNum));
+    std::vector<Point3f> pointSet;
+    std::vector<float> squareDistSet;
+    timeQueries(state, queries, [&](const Point3f& query)
+    {
+        tree.KNNSearch(query, 10, pointSet, squareDistSet);
+        benchmark::DoNotOptimize(pointSet.data());
+    });
+}
+
+static void BM_ApproximateNNSearch(benchmark::State& state)
+{
+    const size_t pointNum = (size_t)state.range(0);
+    const Octree& tree = pointCloudTree(pointNum, (int)state.range(1), (int)state.range(2));
+    std::vector<Point3f> queries = queryPoints(pointCloud(pointNum, (int)state.range(1)), 1 << 16,
+                                               pointSpacing(tree, pointNum));
+    Point3f point;
+    float squareDist;
+    timeQueries(state, queries, [&](const Point3f& query)
+    {
+        tree.approximateNNSearch(query, point, squareDist, 0.2f);
+        benchmark::DoNotOptimize(squareDist);
+    });
+}
+
+static void BM_RadiusNNSearch(benchmark::State& state)
+{
+    const size_t pointNum = (size_t)state.range(0);
+    const Octree& tree = pointCloudTree(pointNum, (int)state.range(1), (int)state.range(2));
+    const float spacing = pointSpacing(tree, pointNum);
+    std::vector<Point3f> queries = queryPoints(pointCloud(pointNum, (int)state.range(1)), 1 << 16, spacing);
+    std::vector<Point3f> pointSet;
+    std::vector<float> squareDistSet;
+    size_t found = 0;
+    timeQueries(state, queries, [&](const Point3f& query)
+    {
+        found += (size_t)tree.radiusNNSearch(query, 2.f * spacing, pointSet, squareDistSet);
+    });
+    state.counters["neighbors"] = benchmark::Counter((double)found, benchmark::Counter::kAvgIterations);
+}
+
+static void BM_DeletePoint(benchmark::State& state)
+{
+    std::vector<Point3f> cloud = pointCloud((size_t)state.range(0), (int)state.range(1));
+    const int maxDepth = (int)state.range(2);
+    std::vector<Point3f> order = cloud;
+    std::shuffle(order.begin(), order.end(), std::mt19937(777));
+
+    Octree tree(maxDepth);
+    tree.convertFromPointCloud(cloud, OCTREE_BUILD_PARALLEL);
+    std::vector<double> latencies;
+    latencies.reserve(std::min<size_t>(order.size(), 1 << 20));
+    size_t i = 0;
+    for(auto _ : state)
+    {
+        if(i == order.size())
+        {
+            state.PauseTiming();
+            tree.convertFromPointCloud(cloud, OCTREE_BUILD_PARALLEL);
+            i = 0;
+            state.ResumeTiming();
+        }
+        auto start = std::chrono::steady_clock::now();
+        benchmark::DoNotOptimize(tree.deletePoint(order[i++]));
+        auto stop = std::chrono::steady_clock::now();
+        if(latencies.size() < latencies.capacity())
+        {
+            latencies.push_back(std::chrono::duration<double, std::nano>(stop - start).count());
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportLatency(state, latencies);
+}
+
+static void BM_TraverseBFS(benchmark::State& state)
+{
+    const Octree& tree = pointCloudTree((size_t)state.range(0), (int)state.range(1), (int)state.range(2));
+    size_t nodeNum = 0;
+    for(auto _ : state)
+    {
+        nodeNum = 0;
+        tree.traverseBFS(tree.rootNode, [&nodeNum](OctreeNode*)
+        {
+            nodeNum++;
+            return OCTREE_TRAVERSAL_CONTINUE;
+        });
+        benchmark::DoNotOptimize(nodeNum);
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)nodeNum);
+    state.counters["nodes"] = (double)nodeNum;
+}
+
+static void BM_TraverseDFS(benchmark::State& state)
+{
+    const Octree& tree = pointCloudTree((size_t)state.range(0), (int)state.range(1), (int)state.range(2));
+    size_t nodeNum = 0;
+    for(auto _ : state)
+    {
+        nodeNum = 0;
+        tree.traverseDFS(tree.rootNode, [&nodeNum](OctreeNode*)
+        {
+            nodeNum++;
+            return OCTREE_TRAVERSAL_CONTINUE;
+        });
+        benchmark::DoNotOptimize(nodeNum);
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)nodeNum);
+    state.counters["nodes"] = (double)nodeNum;
+}
+
+static const int64_t pointNums[] = {1000, 10000, 100000, 1000000, 10000000};
+static const int64_t distributions[] = {DISTRIBUTION_UNIFORM, DISTRIBUTION_BUNNY, DISTRIBUTION_LIDAR};
+static const int64_t maxDepths[] = {6, 10};
+
+static void queryArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"n", "dist", "depth"});
+    for(int64_t distribution : distributions)
+        for(int64_t maxDepth : maxDepths)
+            for(int64_t pointNum : pointNums)
+                b->Args({pointNum, distribution, maxDepth});
+}
+
+static void buildArgs(benchmark::internal::Benchmark* b)
+{
+    const int64_t flags[] = {OCTREE_BUILD_INCREMENTAL, OCTREE_BUILD_MORTON, OCTREE_BUILD_PARALLEL,
+                             OCTREE_BUILD_COMPACT | OCTREE_BUILD_PARALLEL};
+    b->ArgNames({"n", "dist", "depth", "flags"});
+    for(int64_t distribution : distributions)
+        for(int64_t maxDepth : maxDepths)
+            for(int64_t pointNum : pointNums)
+                for(int64_t flag : flags)
+                    b->Args({pointNum, distribution, maxDepth, flag});
+}
+
+BENCHMARK(BM_ConvertFromPointCloud)->Apply(buildArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Index)->Apply(queryArgs);
+BENCHMARK(BM_KNNSearch)->Apply(queryArgs);
+BENCHMARK(BM_ApproximateNNSearch)->Apply(queryArgs);
+BENCHMARK(BM_RadiusNNSearch)->Apply(queryArgs);
+BENCHMARK(BM_DeletePoint)->Apply(queryArgs);
+BENCHMARK(BM_TraverseBFS)->Apply(queryArgs)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TraverseDFS)->Apply(queryArgs)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
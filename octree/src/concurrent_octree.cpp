@@ -0,0 +1,320 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include "concurrent_octree.h"
+#include "morton.h"
+
+namespace cv{
+
+    const int ConcurrentOctree::readerSlotNum;
+
+    ConcurrentOctree::Snapshot::Snapshot(const ConcurrentOctree* _owner, int _slot, const Version* _version):
+            owner(_owner), slot(_slot), version(_version)
+    {
+    }
+
+    ConcurrentOctree::Snapshot::Snapshot(Snapshot&& other):owner(other.owner), slot(other.slot), version(other.version)
+    {
+        other.slot = -1;
+    }
+
+    ConcurrentOctree::Snapshot::~Snapshot()
+    {
+        if(slot >= 0)
+        {
+            owner->unpin(slot);
+        }
+    }
+
+    const Octree& ConcurrentOctree::Snapshot::tree() const
+    {
+        return version->tree;
+    }
+
+    ConcurrentOctree::ConcurrentOctree(int _maxDepth, double _size, Point3f _origin):maxDepth(_maxDepth), size(_size),
+            origin(_origin), current(nullptr), globalEpoch(1), nodePool(makePtr<OctreeNodePool>()), writeRoot(nullptr)
+    {
+        CV_Assert(maxDepth >= 0 && maxDepth <= MORTON_MAX_DEPTH);
+        for(int slot = 0; slot < readerSlotNum; slot++)
+        {
+            readerSlots[slot].store(0);
+        }
+        current.store(new Version(maxDepth, size, origin));
+    }
+
+    ConcurrentOctree::~ConcurrentOctree()
+    {
+        // The nodes go away with the pool.
+        delete current.load();
+        for(size_t i = 0; i < retiredVersions.size(); i++)
+        {
+            delete retiredVersions[i].second;
+        }
+    }
+
+    int ConcurrentOctree::pin(const Version*& version) const
+    {
+        for(;;)
+        {
+            for(int slot = 0; slot < readerSlotNum; slot++)
+            {
+                // The epoch is read before the slot is taken and the version after it. A writer that misses
+                // the slot when reclaiming has already published, so the version read here is a newer one.
+                uint64 expected = 0;
+                uint64 epoch = globalEpoch.load();
+                if(readerSlots[slot].compare_exchange_strong(expected, epoch))
+                {
+                    version = current.load();
+                    return slot;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void ConcurrentOctree::unpin(int slot) const
+    {
+        readerSlots[slot].store(0);
+    }
+
+    ConcurrentOctree::Snapshot ConcurrentOctree::snapshot() const
+    {
+        const Version* version = nullptr;
+        int slot = pin(version);
+        return Snapshot(this, slot, version);
+    }
+
+    int ConcurrentOctree::radiusNNSearch(const Point3f& query, float radius, std::vector<Point3f>& pointSet,
+                                         std::vector<float>& squareDistSet) const
+    {
+        Snapshot pinned = snapshot();
+        return pinned.tree().radiusNNSearch(query, radius, pointSet, squareDistSet);
+    }
+
+    void ConcurrentOctree::KNNSearch(const Point3f& query, const int K, std::vector<Point3f>& pointSet,
+                                     std::vector<float>& squareDistSet) const
+    {
+        Snapshot pinned = snapshot();
+        pinned.tree().KNNSearch(query, K, pointSet, squareDistSet);
+    }
+
+    OctreeNode* ConcurrentOctree::createNode(int depth, double nodeSize, Point3f nodeOrigin, int parentIndex)
+    {
+        OctreeNode* node = nodePool->allocate(depth, nodeSize, nodeOrigin, parentIndex);
+        freshNodes.insert(node);
+        return node;
+    }
+
+    OctreeNode* ConcurrentOctree::writableRoot()
+    {
+        if(writeRoot == nullptr)
+        {
+            writeRoot = createNode(0, size, origin, -1);
+        }
+        else if(freshNodes.count(writeRoot) == 0)
+        {
+            OctreeNode* copy = createNode(0, size, origin, -1);
+            copy->children = writeRoot->children;
+            copy->isLeaf = writeRoot->isLeaf;
+            copy->pointList = writeRoot->pointList;
+            replacedNodes.push_back(writeRoot);
+            writeRoot = copy;
+        }
+        return writeRoot;
+    }
+
+    OctreeNode* ConcurrentOctree::writableChild(OctreeNode* node, int childIndex)
+    {
+        OctreeNode* child = node->children[childIndex];
+        if(child == nullptr || freshNodes.count(child) != 0)
+        {
+            return child;
+        }
+
+        OctreeNode* copy = createNode(child->depth, child->size, child->origin, childIndex);
+        copy->parent = node;
+        copy->children = child->children;
+        copy->isLeaf = child->isLeaf;
+        copy->pointList = child->pointList;
+        replacedNodes.push_back(child);
+        node->children[childIndex] = copy;
+        return copy;
+    }
+
+    void ConcurrentOctree::insertPointInBatch(Point3f& point, uint64 key)
+    {
+        OctreeNode* node = writableRoot();
+        for(int depth = 0; depth < maxDepth; depth++)
+        {
+            int childIndex = (int)((key >> (3 * (maxDepth - depth - 1))) & 7);
+            OctreeNode* child = writableChild(node, childIndex);
+            if(child == nullptr)
+            {
+                // The same geometry as Octree::createChild.
+                size_t xIndex = childIndex & 1;
+                size_t yIndex = (childIndex >> 1) & 1;
+                size_t zIndex = (childIndex >> 2) & 1;
+                double childSize = node->size / 2.0;
+                Point3f childOrigin = node->origin + Point3f(xIndex * childSize,yIndex * childSize, zIndex * childSize);
+                child = createNode(depth + 1, childSize, childOrigin, childIndex);
+                child->parent = node;
+                node->children[childIndex] = child;
+            }
+            node = child;
+        }
+        node->isLeaf = true;
+        node->pointList.push_back(&point);
+    }
+
+    void ConcurrentOctree::insertPoint(Point3f& point)
+    {
+        insertPoints(&point, 1);
+    }
+
+    void ConcurrentOctree::insertPoints(std::vector<Point3f>& points)
+    {
+        insertPoints(points.data(), points.size());
+    }
+
+    void ConcurrentOctree::insertPoints(Point3f* points, size_t pointNum)
+    {
+        if(pointNum == 0)
+        {
+            return;
+        }
+
+        std::vector<uint64> keys(pointNum);
+        if(computeMortonCodes(points, pointNum, origin, size, maxDepth, keys.data()) != 0)
+        {
+            CV_Error(Error::StsBadArg, "The point is out of boundary!");
+        }
+        for(size_t i = 0; i < pointNum; i++)
+        {
+            insertPointInBatch(points[i], keys[i]);
+        }
+        publish();
+    }
+
+    bool ConcurrentOctree::deletePoint(const Point3f& point)
+    {
+        if(writeRoot == nullptr || !Octree::isPointInBound(point, origin, size))
+        {
+            return false;
+        }
+
+        // Find the point first, nothing is copied if it is absent.
+        uint64 key;
+        computeMortonCodes(&point, 1, origin, size, maxDepth, &key);
+        const OctreeNode* leaf = writeRoot;
+        for(int depth = 0; depth < maxDepth && leaf != nullptr; depth++)
+        {
+            leaf = leaf->children[(key >> (3 * (maxDepth - depth - 1))) & 7];
+        }
+        if(leaf == nullptr)
+        {
+            return false;
+        }
+        size_t position = 0;
+        while(position < leaf->pointList.size())
+        {
+            const Point3f* p = leaf->pointList[position];
+            if((point.x == p->x) && (point.y == p->y) && (point.z == p->z))
+                break;
+            position++;
+        }
+        if(position == leaf->pointList.size())
+        {
+            return false;
+        }
+
+        std::vector<OctreeNode*> path(maxDepth + 1);
+        path[0] = writableRoot();
+        for(int depth = 0; depth < maxDepth; depth++)
+        {
+            path[depth + 1] = writableChild(path[depth], (int)((key >> (3 * (maxDepth - depth - 1))) & 7));
+        }
+
+        std::vector<Point3f*>& pointList = path[maxDepth]->pointList;
+        pointList[position] = pointList.back();
+        pointList.pop_back();
+
+        // Drop the emptied leaf and the ancestors left without children. They are all fresh copies.
+        for(int depth = maxDepth; depth >= 0; depth--)
+        {
+            OctreeNode* node = path[depth];
+            bool empty = node->isLeaf ? node->pointList.empty() :
+                         std::all_of(node->children.begin(), node->children.end(),
+                                     [](const OctreeNode* child) { return child == nullptr; });
+            if(!empty)
+            {
+                break;
+            }
+            if(depth > 0)
+            {
+                path[depth - 1]->children[node->parentIndex] = nullptr;
+            }
+            else
+            {
+                writeRoot = nullptr;
+            }
+            freshNodes.erase(node);
+            nodePool->release(node);
+        }
+
+        publish();
+        return true;
+    }
+
+    void ConcurrentOctree::publish()
+    {
+        Version* version = new Version(maxDepth, size, origin);
+        version->tree.rootNode = writeRoot;
+        Version* old = current.exchange(version);
+
+        // Readers pinned at this epoch or before may still be on the old version.
+        uint64 epoch = globalEpoch.fetch_add(1);
+        for(OctreeNode* node : replacedNodes)
+        {
+            retiredNodes.push_back(std::make_pair(epoch, node));
+        }
+        retiredVersions.push_back(std::make_pair(epoch, old));
+        replacedNodes.clear();
+        freshNodes.clear();
+
+        reclaim();
+    }
+
+    void ConcurrentOctree::reclaim()
+    {
+        uint64 oldestPinned = std::numeric_limits<uint64>::max();
+        for(int slot = 0; slot < readerSlotNum; slot++)
+        {
+            uint64 epoch = readerSlots[slot].load();
+            if(epoch != 0)
+            {
+                oldestPinned = std::min(oldestPinned, epoch);
+            }
+        }
+
+        // Both lists are in epoch order.
+        size_t nodeNum = 0;
+        while(nodeNum < retiredNodes.size() && retiredNodes[nodeNum].first < oldestPinned)
+        {
+            nodePool->release(retiredNodes[nodeNum].second);
+            nodeNum++;
+        }
+        retiredNodes.erase(retiredNodes.begin(), retiredNodes.begin() + nodeNum);
+
+        size_t versionNum = 0;
+        while(versionNum < retiredVersions.size() && retiredVersions[versionNum].first < oldestPinned)
+        {
+            delete retiredVersions[versionNum].second;
+            versionNum++;
+        }
+        retiredVersions.erase(retiredVersions.begin(), retiredVersions.begin() + versionNum);
+    }
+}
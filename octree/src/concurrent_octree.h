@@ -0,0 +1,174 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#ifndef OPENCV_OCTREE_CONCURRENT_OCTREE_H
+#define OPENCV_OCTREE_CONCURRENT_OCTREE_H
+
+#include <atomic>
+#include <unordered_set>
+#include <vector>
+#include "octree.h"
+
+namespace cv {
+//! @addtogroup 3d
+//! @{
+
+    /** @brief Octree shared by one writer thread and any number of reader threads, without lock.
+    The writer never modifies a node that readers may see. Every insertion or deletion copies the nodes on the paths
+    it modifies, links the copies to the untouched subtrees, and publishes the new root at once. Readers work on the
+    snapshot that was current when they started, as a plain Octree, and are never blocked by the writer.
+    The replaced nodes are recycled once no reader that could see them is left, with epoch-based reclamation.
+
+    Within a snapshot, OctreeNode::parent is not maintained: subtrees are shared between snapshots with different
+    parents. A snapshot tree is read-only, and its nodes are valid while the snapshot is alive, including the ones
+    returned by Octree::index().
+    */
+    class CV_EXPORTS ConcurrentOctree{
+
+        struct Version;
+
+    public:
+
+        /** @brief A pinned version of the tree. The nodes it refers to stay valid until it is destroyed.
+         * Keep snapshots short-lived: the writer can only recycle the nodes it replaced once all the older snapshots
+         * are released.
+         */
+        class CV_EXPORTS Snapshot{
+        public:
+            Snapshot(Snapshot&& other);
+            Snapshot(const Snapshot&) = delete;
+            Snapshot& operator=(const Snapshot&) = delete;
+            Snapshot& operator=(Snapshot&&) = delete;
+
+            //! destructor - unpins the version
+            ~Snapshot();
+
+            //! The tree of this version, for the const queries of Octree, which only read the nodes.
+            const Octree& tree() const;
+
+        private:
+            friend class ConcurrentOctree;
+            Snapshot(const ConcurrentOctree* owner, int slot, const Version* version);
+
+            const ConcurrentOctree* owner;
+            int slot;
+            const Version* version;
+        };
+
+        /** @brief Create an empty tree.
+         * @param _maxDepth Max depth, up to 21.
+         * @param _size Root cube size.
+         * @param _origin Root cube origin.
+         */
+        ConcurrentOctree(int _maxDepth, double _size, Point3f _origin);
+
+        ConcurrentOctree(const ConcurrentOctree&) = delete;
+        ConcurrentOctree& operator=(const ConcurrentOctree&) = delete;
+
+        //! destructor - no Snapshot may be alive.
+        ~ConcurrentOctree();
+
+        /** @brief Insert a point. Writer thread only.
+         * @param point The point data, the leaf points to it.
+         */
+        void insertPoint(Point3f& point);
+
+        /** @brief Insert a batch of points and publish them as a single new version. Writer thread only.
+         * Every node is copied at most once per batch.
+         * @param points The points to insert.
+         * @param pointNum The number of points.
+         */
+        void insertPoints(Point3f* points, size_t pointNum);
+
+        //! @overload
+        void insertPoints(std::vector<Point3f>& points);
+
+        /** @brief Delete a given point. Writer thread only.
+         * @param point The point coordinates.
+         * @return return ture if the point is deleted successfully.
+         */
+        bool deletePoint(const Point3f& point);
+
+        //! Pin the current version. Any thread.
+        Snapshot snapshot() const;
+
+        //! See Octree::radiusNNSearch. Any thread, runs on the current version.
+        int radiusNNSearch(const Point3f& query, float radius, std::vector<Point3f>& pointSet,
+                           std::vector<float>& squareDistSet) const;
+
+        //! See Octree::KNNSearch. Any thread, runs on the current version.
+        void KNNSearch(const Point3f& query, const int K, std::vector<Point3f>& pointSet,
+                       std::vector<float>& squareDistSet) const;
+
+    private:
+
+        //! A published tree. Its Octree does not own the nodes.
+        struct Version
+        {
+            Version(int maxDepth, double size, Point3f origin):tree(maxDepth, size, origin){}
+            Octree tree;
+        };
+
+        //! The number of readers that can hold a snapshot at the same time, more wait for a free slot.
+        const static int readerSlotNum = 64;
+
+        int maxDepth;
+        double size;
+        Point3f origin;
+
+        //! The version readers start from.
+        std::atomic<Version*> current;
+
+        //! Advanced by every publication.
+        std::atomic<uint64> globalEpoch;
+
+        //! The epoch pinned by each reader, 0 for a free slot.
+        mutable std::atomic<uint64> readerSlots[readerSlotNum];
+
+        // Writer state.
+
+        //! Owns all the nodes of all the versions.
+        Ptr<OctreeNodePool> nodePool;
+
+        //! The root of the version being built.
+        OctreeNode* writeRoot;
+
+        //! The nodes created by the current batch, which can still be modified in place.
+        std::unordered_set<const OctreeNode*> freshNodes;
+
+        //! The published nodes the current batch replaced by copies.
+        std::vector<OctreeNode*> replacedNodes;
+
+        //! The replaced nodes and versions, with the epoch of the version that replaced them.
+        std::vector<std::pair<uint64, OctreeNode*> > retiredNodes;
+        std::vector<std::pair<uint64, Version*> > retiredVersions;
+
+        //! Pin the current epoch in a free reader slot, and return the slot.
+        int pin(const Version*& version) const;
+
+        //! Release a reader slot.
+        void unpin(int slot) const;
+
+        //! A new node for the current batch.
+        OctreeNode* createNode(int depth, double nodeSize, Point3f nodeOrigin, int parentIndex);
+
+        //! The child childIndex of a fresh node, copied first if it is published.
+        OctreeNode* writableChild(OctreeNode* node, int childIndex);
+
+        //! The root of the current batch, copied first if it is published.
+        OctreeNode* writableRoot();
+
+        //! Insert a point in the current batch.
+        void insertPointInBatch(Point3f& point, uint64 key);
+
+        //! Publish the current batch as the new version, and recycle what no reader can see anymore.
+        void publish();
+
+        //! Recycle the retired nodes and versions older than every pinned epoch.
+        void reclaim();
+    };
+//! @} 3d
+}
+
+#endif //OPENCV_OCTREE_CONCURRENT_OCTREE_H
@@ -0,0 +1,483 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include "hashed_octree.h"
+#include "morton.h"
+#include "octree_distance.h"
+
+namespace cv{
+
+    //! Mix the bits of a Morton code, neighbouring voxels differ in a few low bits only.
+    static inline size_t hashMortonCode(uint64 key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return (size_t)key;
+    }
+
+    static inline bool compareDist(const std::pair<float, const Point3f*>& a, const std::pair<float, const Point3f*>& b)
+    {
+        return a.first < b.first;
+    }
+
+    const uint64 HashedOctree::emptyKey;
+
+    HashedOctree::HashedOctree():maxDepth(0), size(0), origin(0,0,0), nodePool(makePtr<OctreeNodePool>()), leafCount(0)
+    {
+    }
+
+    HashedOctree::HashedOctree(int _maxDepth, double _size, Point3f _origin):maxDepth(_maxDepth), size(_size),
+            origin(_origin), nodePool(makePtr<OctreeNodePool>()), leafCount(0)
+    {
+        CV_Assert(maxDepth >= 0 && maxDepth <= MORTON_MAX_DEPTH);
+    }
+
+    HashedOctree::HashedOctree(int _maxDepth, std::vector<Point3f>& _pointCloud):maxDepth(_maxDepth), size(0),
+            origin(0,0,0), nodePool(makePtr<OctreeNodePool>()), leafCount(0)
+    {
+        CV_Assert(maxDepth >= 0 && maxDepth <= MORTON_MAX_DEPTH);
+        convertFromPointCloud(_pointCloud);
+    }
+
+    HashedOctree::~HashedOctree()
+    {
+        clear();
+    }
+
+    bool HashedOctree::convertFromPointCloud(std::vector<Point3f>& pointCloud)
+    {
+        Point3f minBound, maxBound;
+        if(!Octree::findBoundingBox(pointCloud.data(), pointCloud.size(), minBound, maxBound))
+        {
+            return false;
+        }
+
+        clear();
+        fitRootCube(minBound, maxBound, 0.f, origin, size);
+        insertPoints(pointCloud);
+        return true;
+    }
+
+    void HashedOctree::clear()
+    {
+        nodePool->reset();
+        std::fill(slotKeys.begin(), slotKeys.end(), emptyKey);
+        std::fill(slotNodes.begin(), slotNodes.end(), (OctreeNode*)nullptr);
+        leafCount = 0;
+    }
+
+    bool HashedOctree::isEmpty() const
+    {
+        return leafCount == 0;
+    }
+
+    size_t HashedOctree::getLeafCount() const
+    {
+        return leafCount;
+    }
+
+    bool HashedOctree::isPointInBound(const Point3f& point) const
+    {
+        return point.x >= origin.x && point.y >= origin.y && point.z >= origin.z &&
+               point.x <= origin.x + size && point.y <= origin.y + size && point.z <= origin.z + size;
+    }
+
+    uint64 HashedOctree::mortonCode(const Point3f& point) const
+    {
+        uint64 key;
+        computeMortonCodes(&point, 1, origin, size, maxDepth, &key);
+        return key;
+    }
+
+    void HashedOctree::voxelOf(const Point3f& point, int64& x, int64& y, int64& z) const
+    {
+        // The same single precision arithmetic as the Morton codes, floored for the points out of the cube.
+        const float scale = (float)((1 << maxDepth) / size);
+        const float limit = (float)(1LL << 40);
+        x = (int64)std::floor(std::min(std::max((point.x - origin.x) * scale, -limit), limit));
+        y = (int64)std::floor(std::min(std::max((point.y - origin.y) * scale, -limit), limit));
+        z = (int64)std::floor(std::min(std::max((point.z - origin.z) * scale, -limit), limit));
+
+        // The upper faces belong to the last voxel.
+        const int64 cellMax = ((int64)1 << maxDepth) - 1;
+        if(x == cellMax + 1 && point.x <= origin.x + size) x = cellMax;
+        if(y == cellMax + 1 && point.y <= origin.y + size) y = cellMax;
+        if(z == cellMax + 1 && point.z <= origin.z + size) z = cellMax;
+    }
+
+    size_t HashedOctree::findSlot(uint64 key) const
+    {
+        const size_t mask = slotKeys.size() - 1;
+        size_t slot = hashMortonCode(key) & mask;
+        while(slotKeys[slot] != emptyKey && slotKeys[slot] != key)
+        {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    OctreeNode* HashedOctree::findLeaf(uint64 key) const
+    {
+        if(leafCount == 0)
+        {
+            return nullptr;
+        }
+        size_t slot = findSlot(key);
+        return slotKeys[slot] == key ? slotNodes[slot] : nullptr;
+    }
+
+    void HashedOctree::reserve(size_t leafNum)
+    {
+        if(slotKeys.size() >= 2 * leafNum)
+        {
+            return;
+        }
+
+        size_t slotNum = std::max<size_t>(slotKeys.size(), 16);
+        while(slotNum < 2 * leafNum)
+        {
+            slotNum *= 2;
+        }
+
+        std::vector<uint64> oldKeys(slotNum, emptyKey);
+        std::vector<OctreeNode*> oldNodes(slotNum, nullptr);
+        oldKeys.swap(slotKeys);
+        oldNodes.swap(slotNodes);
+        for(size_t i = 0; i < oldKeys.size(); i++)
+        {
+            if(oldKeys[i] != emptyKey)
+            {
+                size_t slot = findSlot(oldKeys[i]);
+                slotKeys[slot] = oldKeys[i];
+                slotNodes[slot] = oldNodes[i];
+            }
+        }
+    }
+
+    void HashedOctree::insertPoint(Point3f& point)
+    {
+        CV_Assert(maxDepth >= 0 && maxDepth <= MORTON_MAX_DEPTH);
+        if(!isPointInBound(point))
+        {
+            CV_Error(Error::StsBadArg, "The point is out of boundary!");
+        }
+        insertPointWithKey(point, mortonCode(point));
+    }
+
+    void HashedOctree::insertPoints(std::vector<Point3f>& points)
+    {
+        insertPoints(points.data(), points.size());
+    }
+
+    void HashedOctree::insertPoints(Point3f* points, size_t pointNum)
+    {
+        CV_Assert(maxDepth >= 0 && maxDepth <= MORTON_MAX_DEPTH);
+        if(pointNum == 0)
+        {
+            return;
+        }
+
+        std::vector<uint64> keys(pointNum);
+        if(computeMortonCodes(points, pointNum, origin, size, maxDepth, keys.data()) != 0)
+        {
+            CV_Error(Error::StsBadArg, "The point is out of boundary!");
+        }
+        for(size_t i = 0; i < pointNum; i++)
+        {
+            insertPointWithKey(points[i], keys[i]);
+        }
+    }
+
+    void HashedOctree::insertPointWithKey(Point3f& point, uint64 key)
+    {
+        reserve(leafCount + 1);
+        size_t slot = findSlot(key);
+        if(slotKeys[slot] == emptyKey)
+        {
+            const double leafSize = size / (double)(1 << maxDepth);
+            Point3f leafOrigin = origin + Point3f((float)(compactMortonBits(key) * leafSize),
+                                                  (float)(compactMortonBits(key >> 1) * leafSize),
+                                                  (float)(compactMortonBits(key >> 2) * leafSize));
+            // The leaf has no parent node, but it is not a root node either: clearing it must not reset the pool.
+            OctreeNode* leaf = nodePool->allocate(maxDepth, leafSize, leafOrigin, (int)(key & 7));
+            leaf->isLeaf = true;
+            slotKeys[slot] = key;
+            slotNodes[slot] = leaf;
+            leafCount++;
+        }
+        slotNodes[slot]->pointList.push_back(&point);
+    }
+
+    OctreeNode* HashedOctree::index(const Point3f& point) const
+    {
+        if(!isPointInBound(point))
+        {
+            return nullptr;
+        }
+        return findLeaf(mortonCode(point));
+    }
+
+    bool HashedOctree::deletePoint(const Point3f& point)
+    {
+        if(!isPointInBound(point))
+        {
+            return false;
+        }
+        const uint64 key = mortonCode(point);
+        OctreeNode* leaf = findLeaf(key);
+        if(leaf == nullptr)
+        {
+            return false;
+        }
+
+        std::vector<Point3f*>& pointList = leaf->pointList;
+        for(size_t i = 0; i < pointList.size(); i++)
+        {
+            const Point3f* p = pointList[i];
+            if((point.x == p->x) && (point.y == p->y) && (point.z == p->z))
+            {
+                pointList[i] = pointList.back();
+                pointList.pop_back();
+                if(pointList.empty())
+                {
+                    removeLeaf(key);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void HashedOctree::removeLeaf(uint64 key)
+    {
+        size_t slot = findSlot(key);
+        if(slotKeys[slot] != key)
+        {
+            return;
+        }
+        nodePool->release(slotNodes[slot]);
+
+        // Backward shift deletion: pull back the following entries of the cluster that may probe through slot.
+        const size_t mask = slotKeys.size() - 1;
+        size_t next = slot;
+        for(;;)
+        {
+            next = (next + 1) & mask;
+            if(slotKeys[next] == emptyKey)
+            {
+                break;
+            }
+            size_t home = hashMortonCode(slotKeys[next]) & mask;
+            bool stays = slot < next ? (home > slot && home <= next) : (home > slot || home <= next);
+            if(!stays)
+            {
+                slotKeys[slot] = slotKeys[next];
+                slotNodes[slot] = slotNodes[next];
+                slot = next;
+            }
+        }
+        slotKeys[slot] = emptyKey;
+        slotNodes[slot] = nullptr;
+        leafCount--;
+    }
+
+    void HashedOctree::collectLeafPoints(const OctreeNode* leaf, const Point3f& query, float squareRadius,
+                                         std::vector<std::pair<float, const Point3f*> >& candidates) const
+    {
+        for(const Point3f* point : leaf->pointList)
+        {
+            float d = squareDist(*point, query);
+            if(d <= squareRadius)
+            {
+                candidates.push_back(std::make_pair(d, point));
+            }
+        }
+    }
+
+    int HashedOctree::radiusNNSearch(const Point3f& query, float radius, std::vector<Point3f>& pointSet,
+                                     std::vector<float>& squareDistSet) const
+    {
+        pointSet.clear();
+        squareDistSet.clear();
+        if(leafCount == 0 || radius < 0)
+        {
+            return 0;
+        }
+
+        const float squareRadius = radius * radius;
+        const int64 cellMax = ((int64)1 << maxDepth) - 1;
+        int64 lowX, lowY, lowZ, highX, highY, highZ;
+        voxelOf(query - Point3f(radius, radius, radius), lowX, lowY, lowZ);
+        voxelOf(query + Point3f(radius, radius, radius), highX, highY, highZ);
+        lowX = std::max<int64>(lowX, 0); lowY = std::max<int64>(lowY, 0); lowZ = std::max<int64>(lowZ, 0);
+        highX = std::min(highX, cellMax); highY = std::min(highY, cellMax); highZ = std::min(highZ, cellMax);
+
+        std::vector<std::pair<float, const Point3f*> > candidates;
+        if(lowX <= highX && lowY <= highY && lowZ <= highZ)
+        {
+            double cellNum = (double)(highX - lowX + 1) * (highY - lowY + 1) * (highZ - lowZ + 1);
+            if(cellNum <= (double)leafCount)
+            {
+                // Look the voxels of the box around the query up.
+                for(int64 z = lowZ; z <= highZ; z++)
+                    for(int64 y = lowY; y <= highY; y++)
+                        for(int64 x = lowX; x <= highX; x++)
+                        {
+                            uint64 key = expandMortonBits(x) | (expandMortonBits(y) << 1) | (expandMortonBits(z) << 2);
+                            const OctreeNode* leaf = findLeaf(key);
+                            if(leaf != nullptr && squareDistToNode(query, leaf) <= squareRadius)
+                                collectLeafPoints(leaf, query, squareRadius, candidates);
+                        }
+            }
+            else
+            {
+                // The box has more voxels than the occupied ones, scan the leaves instead.
+                for(size_t slot = 0; slot < slotKeys.size(); slot++)
+                {
+                    const OctreeNode* leaf = slotNodes[slot];
+                    if(slotKeys[slot] != emptyKey && squareDistToNode(query, leaf) <= squareRadius)
+                        collectLeafPoints(leaf, query, squareRadius, candidates);
+                }
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end(), compareDist);
+        pointSet.resize(candidates.size());
+        squareDistSet.resize(candidates.size());
+        for(size_t i = 0; i < candidates.size(); i++)
+        {
+            squareDistSet[i] = candidates[i].first;
+            pointSet[i] = *candidates[i].second;
+        }
+        return (int)candidates.size();
+    }
+
+    void HashedOctree::KNNSearch(const Point3f& query, const int K, std::vector<Point3f>& pointSet,
+                                 std::vector<float>& squareDistSet) const
+    {
+        pointSet.clear();
+        squareDistSet.clear();
+        if(leafCount == 0 || K <= 0)
+        {
+            return;
+        }
+
+        // A max-heap of the K best points found so far.
+        std::vector<std::pair<float, const Point3f*> > best;
+        auto addLeaf = [&](const OctreeNode* leaf)
+        {
+            if((int)best.size() == K && squareDistToNode(query, leaf) >= best.front().first)
+            {
+                return;
+            }
+            for(const Point3f* point : leaf->pointList)
+            {
+                float d = squareDist(*point, query);
+                if((int)best.size() < K)
+                {
+                    best.push_back(std::make_pair(d, point));
+                    std::push_heap(best.begin(), best.end(), compareDist);
+                }
+                else if(d < best.front().first)
+                {
+                    std::pop_heap(best.begin(), best.end(), compareDist);
+                    best.back() = std::make_pair(d, point);
+                    std::push_heap(best.begin(), best.end(), compareDist);
+                }
+            }
+        };
+
+        const int64 cellMax = ((int64)1 << maxDepth) - 1;
+        const double cellSize = size / (double)(1 << maxDepth);
+        int64 centerX, centerY, centerZ;
+        voxelOf(query, centerX, centerY, centerZ);
+
+        double visited = 0;
+        for(int64 ring = 0; ; ring++)
+        {
+            double ringCells = ring == 0 ? 1.0 : std::pow(2.0 * ring + 1, 3) - std::pow(2.0 * ring - 1, 3);
+            if(visited + ringCells > (double)leafCount)
+            {
+                // The shells would visit more voxels than the occupied ones, scan the leaves not visited yet.
+                for(size_t slot = 0; slot < slotKeys.size(); slot++)
+                {
+                    if(slotKeys[slot] == emptyKey)
+                        continue;
+                    const OctreeNode* leaf = slotNodes[slot];
+                    int64 x, y, z;
+                    voxelOf(leaf->origin + Point3f((float)(cellSize / 2), (float)(cellSize / 2), (float)(cellSize / 2)),
+                            x, y, z);
+                    int64 ringOfLeaf = std::max(std::abs(x - centerX), std::max(std::abs(y - centerY), std::abs(z - centerZ)));
+                    if(ringOfLeaf >= ring)
+                        addLeaf(leaf);
+                }
+                break;
+            }
+
+            // The voxels at Chebyshev distance ring from the voxel of the query.
+            for(int64 dz = -ring; dz <= ring; dz++)
+            {
+                int64 z = centerZ + dz;
+                if(z < 0 || z > cellMax)
+                    continue;
+                for(int64 dy = -ring; dy <= ring; dy++)
+                {
+                    int64 y = centerY + dy;
+                    if(y < 0 || y > cellMax)
+                        continue;
+                    bool face = std::abs(dz) == ring || std::abs(dy) == ring;
+                    int64 step = face || ring == 0 ? 1 : 2 * ring;
+                    for(int64 dx = -ring; dx <= ring; dx += step)
+                    {
+                        int64 x = centerX + dx;
+                        if(x < 0 || x > cellMax)
+                            continue;
+                        uint64 key = expandMortonBits(x) | (expandMortonBits(y) << 1) | (expandMortonBits(z) << 2);
+                        const OctreeNode* leaf = findLeaf(key);
+                        if(leaf != nullptr)
+                            addLeaf(leaf);
+                    }
+                }
+            }
+            visited += ringCells;
+
+            // Every voxel not visited yet is out of the block of the shells, at least as far as its faces.
+            if((int)best.size() == K)
+            {
+                double margin = std::numeric_limits<double>::max();
+                const double q[3] = {query.x - origin.x, query.y - origin.y, query.z - origin.z};
+                const int64 c[3] = {centerX, centerY, centerZ};
+                for(int axis = 0; axis < 3; axis++)
+                {
+                    margin = std::min(margin, q[axis] - (c[axis] - ring) * cellSize);
+                    margin = std::min(margin, (c[axis] + ring + 1) * cellSize - q[axis]);
+                }
+                margin = std::max(margin, 0.0);
+                if(best.front().first <= margin * margin)
+                    break;
+            }
+            if(centerX - ring <= 0 && centerY - ring <= 0 && centerZ - ring <= 0 &&
+               centerX + ring >= cellMax && centerY + ring >= cellMax && centerZ + ring >= cellMax)
+            {
+                break;
+            }
+        }
+
+        std::sort_heap(best.begin(), best.end(), compareDist);
+        pointSet.resize(best.size());
+        squareDistSet.resize(best.size());
+        for(size_t i = 0; i < best.size(); i++)
+        {
+            squareDistSet[i] = best[i].first;
+            pointSet[i] = *best[i].second;
+        }
+    }
+}
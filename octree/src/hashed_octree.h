@@ -0,0 +1,160 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#ifndef OPENCV_OCTREE_HASHED_OCTREE_H
+#define OPENCV_OCTREE_HASHED_OCTREE_H
+
+#include <vector>
+#include "octree.h"
+
+namespace cv {
+//! @addtogroup 3d
+//! @{
+
+    /** @brief Sparse voxel hashing alternative to Octree.
+    Only the leaves of the tree are stored, in an open addressing hash table keyed by their Morton code at maxDepth,
+    see Octree::mortonCode. There are no intermediate levels, so the memory only grows with the occupied voxels, and
+    locating the leaf of a point is a hash lookup instead of a walk down from the root node.
+
+    The leaves are OctreeNodes with depth maxDepth, like the leaves of an Octree with the same root cube, and they
+    hold the same points. They have no parent: a HashedOctree can not be traversed.
+    */
+    class CV_EXPORTS HashedOctree{
+
+    public:
+
+        //! Default constructor.
+        HashedOctree();
+
+        /** @overload
+         * @brief Create an empty tree.
+         * @param _maxDepth Max depth, up to 21.
+         * @param _size Root cube size.
+         * @param _origin Root cube origin.
+         */
+        HashedOctree(int _maxDepth, double _size, Point3f _origin);
+
+        /** @overload
+         * @brief Create a tree from the point cloud data with the specific max depth.
+         * @param _maxDepth Max depth, up to 21.
+         * @param _pointCloud Point cloud data.
+         */
+        HashedOctree(int _maxDepth, std::vector<Point3f>& _pointCloud);
+
+        HashedOctree(const HashedOctree&) = delete;
+        HashedOctree& operator=(const HashedOctree&) = delete;
+
+        //! destructor - calls clear()
+        ~HashedOctree();
+
+        /** @brief Fit the root cube to the point cloud and insert all its points, any existing leaf is dropped first.
+         * The root cube is the one Octree::convertFromPointCloud would choose with the default padding.
+         * @param pointCloud PointCloud data. The leaves point to it, it must outlive the tree.
+         * @return Returns whether the creation is successful, false for an empty point cloud.
+         */
+        bool convertFromPointCloud(std::vector<Point3f>& pointCloud);
+
+        /** @brief Insert a point.
+         * @param point The point data, the leaf points to it.
+         */
+        void insertPoint(Point3f& point);
+
+        /** @brief Insert a batch of points. Their Morton codes are computed in one pass.
+         * @param points The points to insert.
+         * @param pointNum The number of points.
+         */
+        void insertPoints(Point3f* points, size_t pointNum);
+
+        //! @overload
+        void insertPoints(std::vector<Point3f>& points);
+
+        /** @brief Locate the leaf containing a point.
+         * The leaf belongs to the table: OctreeNode::clear() leaves it alone, use deletePoint() to remove its points.
+         * @param point The point to be located.
+         * @return The pointer to the leaf, or NULL if the voxel of the point is empty.
+         */
+        OctreeNode* index(const Point3f& point) const;
+
+        /** @brief Delete a given point from the tree. A leaf left without points is dropped.
+         * @param point The point coordinates.
+         * @return return ture if the point is deleted successfully.
+         */
+        bool deletePoint(const Point3f& point);
+
+        //! See Octree::radiusNNSearch.
+        int radiusNNSearch(const Point3f& query, float radius, std::vector<Point3f>& pointSet,
+                           std::vector<float>& squareDistSet) const;
+
+        /** @brief K Nearest Neighbor Search, see Octree::KNNSearch.
+         * The voxels are visited in shells of growing distance around the voxel of the query. When the shells would
+         * cover more voxels than the occupied ones, the remaining leaves are scanned instead.
+         */
+        void KNNSearch(const Point3f& query, const int K, std::vector<Point3f>& pointSet,
+                       std::vector<float>& squareDistSet) const;
+
+        //! Determine whether the point is within the root cube, see Octree::isPointInBound.
+        bool isPointInBound(const Point3f& point) const;
+
+        //! returns true if no point is stored.
+        bool isEmpty() const;
+
+        //! The number of occupied voxels.
+        size_t getLeafCount() const;
+
+        //! Delete all the leaves. The root cube is kept.
+        void clear();
+
+        //! Max depth of the tree.
+        int maxDepth;
+
+        //! The size of the root cube.
+        double size;
+
+        //! The origin coordinate of the root cube.
+        Point3f origin;
+
+    private:
+
+        //! Owns the leaves.
+        Ptr<OctreeNodePool> nodePool;
+
+        //! The hash table, a power of two. Empty slots have the key emptyKey.
+        std::vector<uint64> slotKeys;
+        std::vector<OctreeNode*> slotNodes;
+
+        //! The number of occupied slots.
+        size_t leafCount;
+
+        //! No Morton code of 63 bits can have all the bits set.
+        const static uint64 emptyKey = ~(uint64)0;
+
+        //! The slot of key, or of the first empty slot of its probe sequence.
+        size_t findSlot(uint64 key) const;
+
+        //! Grow the table so that it holds leafNum leaves at most half full.
+        void reserve(size_t leafNum);
+
+        //! The leaf of key, NULL if absent.
+        OctreeNode* findLeaf(uint64 key) const;
+
+        //! Insert a point whose Morton code is key.
+        void insertPointWithKey(Point3f& point, uint64 key);
+
+        //! Remove the leaf of key from the table and give it back to the pool.
+        void removeLeaf(uint64 key);
+
+        //! The Morton code of a point inside the root cube.
+        uint64 mortonCode(const Point3f& point) const;
+
+        //! The integer coordinates of the voxel of a point, out of [0, 2^maxDepth) for points out of the root cube.
+        void voxelOf(const Point3f& point, int64& x, int64& y, int64& z) const;
+
+        //! Add the points of leaf within sqrt(squareRadius) of query to candidates.
+        void collectLeafPoints(const OctreeNode* leaf, const Point3f& query, float squareRadius,
+                               std::vector<std::pair<float, const Point3f*> >& candidates) const;
+    };
+//! @} 3d
+}
+
+#endif //OPENCV_OCTREE_HASHED_OCTREE_H
@@ -1,7 +1,7 @@
 #include <iostream>
 #include "octree.h"
+#include "ply_reader.h"
 #include <opencv2/viz/viz3d.hpp>
-#include <fstream>
 
 using namespace std;
 using namespace cv;
@@ -10,43 +10,39 @@ vector<Point3f> loadPointCloud(string fileName)
 {
     vector<Point3f> pointCloud;
 
-    ifstream ifs(fileName);
-    string str;
-
-    for(size_t i = 0; i < 12; ++i)
-        getline(ifs, str);
-
-    Point3f temp;
-    float dummy1, dummy2;
-
-    for(size_t i = 0; i < 1889; ++i)
+    PLYReader reader;
+    if(!reader.open(fileName) || !reader.read(pointCloud))
     {
-        ifs >> temp.x >> temp.y >> temp.z >> dummy1 >> dummy2;
-        temp *= 5.0f;
-        pointCloud.push_back(temp);
+        cerr<<"can't read the point cloud "<<fileName<<endl;
+        return pointCloud;
     }
 
+    for(Point3f& point : pointCloud)
+        point *= 5.0f;
+
     return pointCloud;
 }
 
-void Traverse( OctreeNode*& node, viz::WWidgetMerger& merger){
+viz::WMesh LeafBoxes(const Octree& tree){
 
-    if(node == nullptr)
-    {
-        std::cerr<<"node empty"<<std::endl;
-        return;
-    }
-    else
-    {
-    viz::WCube cubeW(node->origin, node->origin + Point3f(node->size, node->size, node->size), !(node->isLeaf), viz::Color::white());
-    merger.addWidget(cubeW);
+    // One mesh for all the leaves rather than a widget per node.
+    vector<Point3f> vertices;
+    vector<int> indices;
+    tree.exportNodeBoxes(-1, vertices, indices);
 
-    for(size_t child_index = 0; child_index < 8; ++child_index)
+    // viz expects [3, a, b, c] per triangle.
+    vector<int> polygons;
+    polygons.reserve(indices.size() / 3 * 4);
+    for(size_t i = 0; i < indices.size(); i += 3)
     {
-        if(node->children[child_index] != nullptr)
-            Traverse(node->children[child_index], merger);
-    }
+        polygons.push_back(3);
+        polygons.insert(polygons.end(), indices.begin() + i, indices.begin() + i + 3);
     }
+
+    viz::Mesh mesh;
+    mesh.cloud = Mat(vertices, true).reshape(3, 1);
+    mesh.polygons = Mat(polygons, true).reshape(1, 1);
+    return viz::WMesh(mesh);
 }
 
 int main()
@@ -55,6 +51,11 @@ int main()
     vector<Point3f> data = loadPointCloud(bunny_name);
     Octree tree(6, data);
     cout<<"load point cloud successfully."<<endl;
+    if(tree.rootNode == nullptr)
+    {
+        cerr<<"node empty"<<endl;
+        return 1;
+    }
 
     // test
 
@@ -82,12 +83,7 @@ int main()
     // Visualization
     viz::Viz3d myWindow("Octree");  // create window
 
-    viz::WWidgetMerger merger;
-
-    Traverse(tree.rootNode, merger);
-
-    merger.finalize();
-    myWindow.showWidget("Cube Widget", merger);
+    myWindow.showWidget("Cube Widget", LeafBoxes(tree));
 
     myWindow.spin();
 
@@ -0,0 +1,121 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace cv{
+
+#ifdef _WIN32
+    MappedFile::MappedFile():mappedData(nullptr), mappedSize(0), fileHandle(nullptr), mappingHandle(nullptr)
+    {
+    }
+#else
+    MappedFile::MappedFile():mappedData(nullptr), mappedSize(0)
+    {
+    }
+#endif
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+
+    bool MappedFile::open(const std::string& path)
+    {
+        close();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if(file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(mapping == nullptr)
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(view == nullptr)
+        {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+
+        fileHandle = file;
+        mappingHandle = mapping;
+        mappedData = (const uchar*)view;
+        mappedSize = (size_t)fileSize.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+        {
+            return false;
+        }
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // The mapping stays valid after the descriptor is closed.
+        ::close(fd);
+        if(view == MAP_FAILED)
+        {
+            return false;
+        }
+
+        mappedData = (const uchar*)view;
+        mappedSize = (size_t)st.st_size;
+#endif
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if(mappedData == nullptr)
+        {
+            return;
+        }
+
+#ifdef _WIN32
+        UnmapViewOfFile(mappedData);
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        mappingHandle = nullptr;
+        fileHandle = nullptr;
+#else
+        munmap((void*)mappedData, mappedSize);
+#endif
+        mappedData = nullptr;
+        mappedSize = 0;
+    }
+}
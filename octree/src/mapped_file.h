@@ -0,0 +1,52 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#ifndef OPENCV_OCTREE_MAPPED_FILE_H
+#define OPENCV_OCTREE_MAPPED_FILE_H
+
+#include <string>
+#include "opencv2/core.hpp"
+
+namespace cv {
+
+    /** @brief Read-only memory mapping of a whole file.
+     * The mapping lives as long as the object, so anything pointing into data() must keep the MappedFile alive.
+     */
+    class MappedFile{
+    public:
+
+        MappedFile();
+
+        //! destructor - calls close()
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        /** @brief Map the file read-only.
+         * @param path The path of the file.
+         * @return Returns whether the mapping is successful.
+         */
+        bool open(const std::string& path);
+
+        //! Unmap the file.
+        void close();
+
+        //! The first byte of the file, NULL if nothing is mapped.
+        const uchar* data() const { return mappedData; }
+
+        //! The size of the file in bytes.
+        size_t size() const { return mappedSize; }
+
+    private:
+        const uchar* mappedData;
+        size_t mappedSize;
+#ifdef _WIN32
+        void* fileHandle;
+        void* mappingHandle;
+#endif
+    };
+}
+
+#endif //OPENCV_OCTREE_MAPPED_FILE_H
@@ -0,0 +1,166 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "morton.h"
+#include "opencv2/core/hal/intrin.hpp"
+
+namespace cv{
+
+    /** @brief The smallest float not below v.
+     * A float is then at most the float upper bound exactly when it is at most the double one.
+     */
+    static inline float roundUpToFloat(double v)
+    {
+        float f = (float)v;
+        return (double)f < v ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+    }
+
+    /** @brief The cell of a coordinate on one axis, from 0 to cellMax.
+     * The cell is clamped in floating point, so that a NaN, which goes to 0, or a coordinate far out of the root
+     * cube never reaches the integer conversion.
+     */
+    static inline int mortonCell(float coord, float originCoord, float scale, int cellMax)
+    {
+        float cell = (coord - originCoord) * scale;
+        if(!(cell > 0))
+        {
+            return 0;
+        }
+        return cell >= (float)cellMax ? cellMax : (int)cell;
+    }
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    //! mortonCell on a SIMD register of coordinates.
+    static inline v_int32 mortonCells(const v_float32& coord, const v_float32& originCoord, const v_float32& scale,
+                                       const v_float32& cellMax)
+    {
+        v_float32 cell = v_mul(v_sub(coord, originCoord), scale);
+        // A NaN compares unequal to itself, the mask clears it to 0.
+        cell = v_and(cell, v_eq(cell, cell));
+        return v_trunc(v_min(v_max(cell, vx_setall_f32(0)), cellMax));
+    }
+#endif
+
+    size_t computeMortonCodes(const Point3f* points, size_t pointNum, const Point3f& origin, double size,
+                              int maxDepth, uint64* keys)
+    {
+        const int cellMax = (1 << maxDepth) - 1;
+        const float scale = (float)((1 << maxDepth) / size);
+        const Point3f upper(roundUpToFloat(origin.x + size), roundUpToFloat(origin.y + size),
+                            roundUpToFloat(origin.z + size));
+        size_t inside = 0;
+        size_t i = 0;
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+        const int lanes = VTraits<v_float32>::vlanes();
+        int cells[3 * VTraits<v_float32>::max_nlanes];
+        v_float32 vOriginX = vx_setall_f32(origin.x), vOriginY = vx_setall_f32(origin.y), vOriginZ = vx_setall_f32(origin.z);
+        v_float32 vUpperX = vx_setall_f32(upper.x), vUpperY = vx_setall_f32(upper.y), vUpperZ = vx_setall_f32(upper.z);
+        v_float32 vScale = vx_setall_f32(scale), vCellMax = vx_setall_f32((float)cellMax);
+        v_int32 vOne = vx_setall_s32(1);
+        v_int32 vInside = vx_setall_s32(0);
+        for(; i + lanes <= pointNum; i += lanes)
+        {
+            v_float32 x, y, z;
+            v_load_deinterleave(&points[i].x, x, y, z);
+
+            v_float32 inBound = v_and(v_and(v_and(v_ge(x, vOriginX), v_le(x, vUpperX)),
+                                            v_and(v_ge(y, vOriginY), v_le(y, vUpperY))),
+                                      v_and(v_ge(z, vOriginZ), v_le(z, vUpperZ)));
+            vInside = v_add(vInside, v_and(v_reinterpret_as_s32(inBound), vOne));
+
+            v_store(cells, mortonCells(x, vOriginX, vScale, vCellMax));
+            v_store(cells + lanes, mortonCells(y, vOriginY, vScale, vCellMax));
+            v_store(cells + 2 * lanes, mortonCells(z, vOriginZ, vScale, vCellMax));
+            for(int k = 0; k < lanes; k++)
+            {
+                keys[i + k] = expandMortonBits(cells[k]) | (expandMortonBits(cells[lanes + k]) << 1) |
+                              (expandMortonBits(cells[2 * lanes + k]) << 2);
+            }
+        }
+        inside = v_reduce_sum(vInside);
+        vx_cleanup();
+#endif
+
+        for(; i < pointNum; i++)
+        {
+            const Point3f& p = points[i];
+            if(p.x >= origin.x && p.x <= upper.x && p.y >= origin.y && p.y <= upper.y && p.z >= origin.z && p.z <= upper.z)
+            {
+                inside++;
+            }
+            int x = mortonCell(p.x, origin.x, scale, cellMax);
+            int y = mortonCell(p.y, origin.y, scale, cellMax);
+            int z = mortonCell(p.z, origin.z, scale, cellMax);
+            keys[i] = expandMortonBits(x) | (expandMortonBits(y) << 1) | (expandMortonBits(z) << 2);
+        }
+        return pointNum - inside;
+    }
+
+    void radixSortMorton(uint64* keys, int* indices, size_t n, int keyBits, uint64* keysTmp, int* indicesTmp)
+    {
+        const int radixBits = 8;
+        const size_t radix = 1 << radixBits;
+        size_t count[radix];
+        bool swapped = false;
+
+        for(int shift = 0; shift < keyBits; shift += radixBits)
+        {
+            std::fill(count, count + radix, 0);
+            for(size_t i = 0; i < n; i++)
+            {
+                count[(keys[i] >> shift) & (radix - 1)]++;
+            }
+
+            size_t offset = 0;
+            for(size_t d = 0; d < radix; d++)
+            {
+                size_t c = count[d];
+                count[d] = offset;
+                offset += c;
+            }
+
+            for(size_t i = 0; i < n; i++)
+            {
+                size_t dst = count[(keys[i] >> shift) & (radix - 1)]++;
+                keysTmp[dst] = keys[i];
+                indicesTmp[dst] = indices[i];
+            }
+            std::swap(keys, keysTmp);
+            std::swap(indices, indicesTmp);
+            swapped = !swapped;
+        }
+
+        // An odd number of passes leaves the result in the scratch buffers.
+        if(swapped)
+        {
+            std::copy(keys, keys + n, keysTmp);
+            std::copy(indices, indices + n, indicesTmp);
+        }
+    }
+
+    void fitRootCube(const Point3f& minBound, const Point3f& maxBound, float padding, Point3f& origin, double& size)
+    {
+        // The cube is centered on the box, its size is the largest extent of the box plus the padding.
+        double extent = std::max((double)maxBound.x - minBound.x,
+                                 std::max((double)maxBound.y - minBound.y, (double)maxBound.z - minBound.z));
+        extent *= 1.0 + 2.0 * padding;
+        if(extent <= 0)
+        {
+            // All the points are at the same position.
+            extent = 1.0;
+        }
+
+        Point3f center = (minBound + maxBound) * 0.5f;
+        origin = Point3f((float)(center.x - extent / 2), (float)(center.y - extent / 2), (float)(center.z - extent / 2));
+
+        // Rounding to float must not leave the extreme points out of the cube.
+        origin = Point3f(std::min(origin.x, minBound.x), std::min(origin.y, minBound.y), std::min(origin.z, minBound.z));
+        size = std::max(extent, std::max((double)maxBound.x - origin.x,
+                                         std::max((double)maxBound.y - origin.y, (double)maxBound.z - origin.z)));
+    }
+}
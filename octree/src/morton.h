@@ -0,0 +1,73 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#ifndef OPENCV_OCTREE_MORTON_H
+#define OPENCV_OCTREE_MORTON_H
+
+#include "opencv2/core.hpp"
+
+// Morton (Z-order) codes and root cube helpers shared by the Octree and HashedOctree implementations.
+// Not part of the public API.
+
+namespace cv {
+
+    //! The deepest level that fits in a 64-bit Morton code.
+    static const int MORTON_MAX_DEPTH = 21;
+
+    //! Spread the low 21 bits of v so that there are two zero bits between consecutive bits.
+    inline uint64 expandMortonBits(uint64 v)
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffULL;
+        v = (v | v << 16) & 0x1f0000ff0000ffULL;
+        v = (v | v << 8) & 0x100f00f00f00f00fULL;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+        v = (v | v << 2) & 0x1249249249249249ULL;
+        return v;
+    }
+
+    //! The inverse of expandMortonBits, gather every third bit of v.
+    inline uint64 compactMortonBits(uint64 v)
+    {
+        v &= 0x1249249249249249ULL;
+        v = (v | v >> 2) & 0x10c30c30c30c30c3ULL;
+        v = (v | v >> 4) & 0x100f00f00f00f00fULL;
+        v = (v | v >> 8) & 0x1f0000ff0000ffULL;
+        v = (v | v >> 16) & 0x1f00000000ffffULL;
+        v = (v | v >> 32) & 0x1fffff;
+        return v;
+    }
+
+    /** @brief Compute the Morton codes of a block of points, see Octree::mortonCode.
+     * The points are classified against the root cube and quantized a SIMD register at a time, and the tail is
+     * handled with the same single precision arithmetic, so every point gets the same code whatever its position
+     * in the block. The points on the upper faces go to the last cells.
+     * @return The number of points that are not inside the root cube, see Octree::isPointInBound.
+     */
+    size_t computeMortonCodes(const Point3f* points, size_t pointNum, const Point3f& origin, double size,
+                              int maxDepth, uint64* keys);
+
+    /** @brief Stable LSD radix sort of (key, index) pairs on the lowest keyBits bits of the keys.
+     * Stability keeps the original order of the points sharing a key, which is the insertion order
+     * of pointList in the incremental build.
+     */
+    void radixSortMorton(uint64* keys, int* indices, size_t n, int keyBits, uint64* keysTmp, int* indicesTmp);
+
+    /** @brief computeMortonCodes and radixSortMorton on the OpenCL device of cv::ocl, see OCTREE_BUILD_OPENCL.
+     * The codes are the same as on the CPU, and the indices of the points sharing a code stay in ascending order.
+     * @param keys Output, the sorted codes of the points.
+     * @param indices Output, the indices of the points in the order of keys.
+     * @param outsideNum Output, the number of points that are not inside the root cube.
+     * @return false if the build has no OpenCL backend or there is no device, nothing is computed then.
+     */
+    bool oclSortMortonCodes(const Point3f* points, size_t pointNum, const Point3f& origin, double size, int maxDepth,
+                            uint64* keys, int* indices, size_t& outsideNum);
+
+    /** @brief The root cube fitted to a bounding box, see Octree::setBoundPadding.
+     * The cube is centered on the box, and rounding to float never leaves a corner of the box out of it.
+     */
+    void fitRootCube(const Point3f& minBound, const Point3f& maxBound, float padding, Point3f& origin, double& size);
+}
+
+#endif //OPENCV_OCTREE_MORTON_H
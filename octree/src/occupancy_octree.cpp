@@ -0,0 +1,483 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include "occupancy_octree.h"
+#include "morton.h"
+
+namespace cv{
+
+    // 10 fractional bits leave room for log-odds up to +-32, a probability within 1e-14 of 0 or 1.
+    const float OccupancyOctree::logOddsScale = 1024.f;
+
+    //! Sort keys and drop the duplicates.
+    static void sortUniqueKeys(std::vector<uint64>& keys)
+    {
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+
+    OccupancyOctree::OccupancyOctree(int _maxDepth, double _size, Point3f _origin, int _summaryMode):rootNode(nullptr),
+            maxDepth(_maxDepth), size(_size), origin(_origin), nodePool(makePtr<OctreeNodePool>()),
+            summaryMode(_summaryMode)
+    {
+        CV_Assert(maxDepth >= 0 && maxDepth <= MORTON_MAX_DEPTH);
+        CV_Assert(summaryMode == OCCUPANCY_SUMMARY_MAX || summaryMode == OCCUPANCY_SUMMARY_MEAN);
+        setSensorModel(0.7f, 0.4f);
+        setClampingThresholds(0.12f, 0.97f);
+        setOccupancyThreshold(0.5f);
+    }
+
+    OccupancyOctree::~OccupancyOctree()
+    {
+        clear();
+    }
+
+    int OccupancyOctree::toLogOdds(float prob)
+    {
+        CV_Assert(prob > 0 && prob < 1);
+        double logOdds = std::round(std::log((double)prob / (1.0 - prob)) * logOddsScale);
+        return (int)std::min(std::max(logOdds, (double)SHRT_MIN), (double)SHRT_MAX);
+    }
+
+    void OccupancyOctree::setSensorModel(float probHit, float probMiss)
+    {
+        hitLogOdds = toLogOdds(probHit);
+        missLogOdds = toLogOdds(probMiss);
+    }
+
+    void OccupancyOctree::setClampingThresholds(float probMin, float probMax)
+    {
+        CV_Assert(probMin <= probMax);
+        clampMin = toLogOdds(probMin);
+        clampMax = toLogOdds(probMax);
+    }
+
+    void OccupancyOctree::setOccupancyThreshold(float prob)
+    {
+        occupancyThreshold = toLogOdds(prob);
+    }
+
+    float OccupancyOctree::getLogOdds(const OctreeNode* node)
+    {
+        return node->logOdds / logOddsScale;
+    }
+
+    float OccupancyOctree::getProbability(const OctreeNode* node)
+    {
+        return 1.f - 1.f / (1.f + std::exp(getLogOdds(node)));
+    }
+
+    bool OccupancyOctree::isNodeOccupied(const OctreeNode* node) const
+    {
+        return node->logOdds > occupancyThreshold;
+    }
+
+    void OccupancyOctree::clear()
+    {
+        nodePool->reset();
+        rootNode = nullptr;
+    }
+
+    size_t OccupancyOctree::getNodeCount() const
+    {
+        return nodePool->nodeCount();
+    }
+
+    OctreeNode* OccupancyOctree::createChild(OctreeNode* node, int childIndex, bool leaf)
+    {
+        // The same geometry as Octree::createChild.
+        size_t xIndex = childIndex & 1;
+        size_t yIndex = (childIndex >> 1) & 1;
+        size_t zIndex = (childIndex >> 2) & 1;
+        double childSize = node->size / 2.0;
+        Point3f childOrigin = node->origin + Point3f(xIndex * childSize, yIndex * childSize, zIndex * childSize);
+        OctreeNode* child = nodePool->allocate(node->depth + 1, childSize, childOrigin, childIndex);
+        child->parent = node;
+        child->isLeaf = leaf;
+        node->children[childIndex] = child;
+        return child;
+    }
+
+    void OccupancyOctree::expandNode(OctreeNode* node)
+    {
+        for(int childIndex = 0; childIndex < OctreeNode::childNum; childIndex++)
+        {
+            createChild(node, childIndex, true)->logOdds = node->logOdds;
+        }
+        node->isLeaf = false;
+    }
+
+    void OccupancyOctree::updateCells(const std::vector<uint64>& keys, int delta,
+                                      std::vector<std::vector<OctreeNode*> >& touched)
+    {
+        if(keys.empty())
+        {
+            return;
+        }
+        if(rootNode == nullptr)
+        {
+            rootNode = nodePool->allocate(0, size, origin, -1);
+            rootNode->isLeaf = maxDepth == 0;
+        }
+
+        // Nothing is pruned until the summaries are updated, so the path of the previous cell stays valid down to
+        // the last level it shares with the current one.
+        std::vector<OctreeNode*> path(maxDepth + 1);
+        path[0] = rootNode;
+        for(size_t i = 0; i < keys.size(); i++)
+        {
+            const uint64 key = keys[i];
+            int depth = 0;
+            if(i > 0)
+            {
+                while(depth < maxDepth - 1 && ((key ^ keys[i - 1]) >> (3 * (maxDepth - depth - 1))) == 0)
+                {
+                    depth++;
+                }
+            }
+
+            OctreeNode* node = path[depth];
+            for(; depth < maxDepth; depth++)
+            {
+                if(node->isLeaf)
+                {
+                    expandNode(node);
+                }
+                int childIndex = (int)((key >> (3 * (maxDepth - depth - 1))) & 7);
+                OctreeNode* child = node->children[childIndex];
+                if(child == nullptr)
+                {
+                    child = createChild(node, childIndex, depth + 1 == maxDepth);
+                    if(touched[depth].empty() || touched[depth].back() != node)
+                    {
+                        touched[depth].push_back(node);
+                    }
+                }
+                node = child;
+                path[depth + 1] = node;
+            }
+
+            node->logOdds = (short)std::min(std::max(node->logOdds + delta, clampMin), clampMax);
+            if(maxDepth > 0 && (touched[maxDepth - 1].empty() || touched[maxDepth - 1].back() != node->parent))
+            {
+                touched[maxDepth - 1].push_back(node->parent);
+            }
+        }
+    }
+
+    bool OccupancyOctree::updateSummary(OctreeNode* node)
+    {
+        int count = 0;
+        int maxLogOdds = INT_MIN;
+        int64 sumLogOdds = 0;
+        bool uniform = true;
+        for(int childIndex = 0; childIndex < OctreeNode::childNum; childIndex++)
+        {
+            const OctreeNode* child = node->children[childIndex];
+            if(child == nullptr)
+            {
+                uniform = false;
+                continue;
+            }
+            count++;
+            maxLogOdds = std::max(maxLogOdds, (int)child->logOdds);
+            sumLogOdds += child->logOdds;
+            uniform = uniform && child->isLeaf && child->logOdds == node->children[0]->logOdds;
+        }
+        if(count == 0)
+        {
+            return false;
+        }
+
+        if(uniform)
+        {
+            node->logOdds = node->children[0]->logOdds;
+            for(int childIndex = 0; childIndex < OctreeNode::childNum; childIndex++)
+            {
+                nodePool->release(node->children[childIndex]);
+            }
+            node->children.fill(nullptr);
+            node->isLeaf = true;
+            return true;
+        }
+
+        const short previous = node->logOdds;
+        if(summaryMode == OCCUPANCY_SUMMARY_MAX)
+        {
+            node->logOdds = (short)maxLogOdds;
+        }
+        else
+        {
+            node->logOdds = (short)std::round((double)sumLogOdds / count);
+        }
+        return node->logOdds != previous;
+    }
+
+    void OccupancyOctree::updateSummaries(std::vector<std::vector<OctreeNode*> >& touched)
+    {
+        // A level is done before its parents, which only need an update if a child changed. Nodes are only
+        // pruned by their parent, after their own level.
+        for(int depth = maxDepth - 1; depth >= 0; depth--)
+        {
+            std::vector<OctreeNode*>& nodes = touched[depth];
+            std::sort(nodes.begin(), nodes.end());
+            nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+            for(OctreeNode* node : nodes)
+            {
+                if(updateSummary(node) && depth > 0)
+                {
+                    touched[depth - 1].push_back(node->parent);
+                }
+            }
+            nodes.clear();
+        }
+    }
+
+    void OccupancyOctree::traceRays(const Point3f* points, size_t pointNum, const Point3f& sensorOrigin,
+                                    float maxRange, std::vector<uint64>& freeKeys, std::vector<uint64>& hitKeys) const
+    {
+        const int64 cellNum = (int64)1 << maxDepth;
+        const double cellSize = size / (double)cellNum;
+        const double low[3] = {origin.x, origin.y, origin.z};
+        const double o[3] = {sensorOrigin.x, sensorOrigin.y, sensorOrigin.z};
+        auto cellKey = [](const int64* cell)
+        {
+            return expandMortonBits(cell[0]) | (expandMortonBits(cell[1]) << 1) | (expandMortonBits(cell[2]) << 2);
+        };
+
+        for(size_t i = 0; i < pointNum; i++)
+        {
+            Point3f end = points[i];
+            double d[3] = {end.x - o[0], end.y - o[1], end.z - o[2]};
+            const double length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            bool hit = true;
+            if(maxRange >= 0 && length > maxRange)
+            {
+                const double scale = maxRange / length;
+                for(int axis = 0; axis < 3; axis++)
+                {
+                    d[axis] *= scale;
+                }
+                end = Point3f((float)(o[0] + d[0]), (float)(o[1] + d[1]), (float)(o[2] + d[2]));
+                hit = false;
+            }
+            uint64 endKey;
+            hit = hit && computeMortonCodes(&end, 1, origin, size, maxDepth, &endKey) == 0;
+            if(hit)
+            {
+                hitKeys.push_back(endKey);
+            }
+
+            // Clip the segment from the sensor to the end point, t in [0, 1], to the root cube.
+            double tEnter = 0, tExit = 1;
+            for(int axis = 0; axis < 3; axis++)
+            {
+                if(d[axis] == 0)
+                {
+                    if(o[axis] < low[axis] || o[axis] > low[axis] + size)
+                    {
+                        tExit = -1;
+                    }
+                    continue;
+                }
+                double t0 = (low[axis] - o[axis]) / d[axis];
+                double t1 = (low[axis] + size - o[axis]) / d[axis];
+                if(t0 > t1)
+                {
+                    std::swap(t0, t1);
+                }
+                tEnter = std::max(tEnter, t0);
+                tExit = std::min(tExit, t1);
+            }
+            if(tEnter > tExit)
+            {
+                continue;
+            }
+
+            // Step from cell to cell through the face the ray leaves by, Amanatides and Woo.
+            int64 cell[3], last[3], step[3];
+            double tMax[3], tDelta[3];
+            for(int axis = 0; axis < 3; axis++)
+            {
+                double enter = (o[axis] + d[axis] * tEnter - low[axis]) / cellSize;
+                double exit = (o[axis] + d[axis] * tExit - low[axis]) / cellSize;
+                cell[axis] = std::min(std::max((int64)std::floor(enter), (int64)0), cellNum - 1);
+                last[axis] = std::min(std::max((int64)std::floor(exit), (int64)0), cellNum - 1);
+                if(d[axis] > 0)
+                {
+                    step[axis] = 1;
+                    tMax[axis] = (low[axis] + (cell[axis] + 1) * cellSize - o[axis]) / d[axis];
+                    tDelta[axis] = cellSize / d[axis];
+                }
+                else if(d[axis] < 0)
+                {
+                    step[axis] = -1;
+                    tMax[axis] = (low[axis] + cell[axis] * cellSize - o[axis]) / d[axis];
+                    tDelta[axis] = -cellSize / d[axis];
+                }
+                else
+                {
+                    step[axis] = 0;
+                    tMax[axis] = std::numeric_limits<double>::infinity();
+                    tDelta[axis] = std::numeric_limits<double>::infinity();
+                }
+            }
+
+            while(cell[0] != last[0] || cell[1] != last[1] || cell[2] != last[2])
+            {
+                freeKeys.push_back(cellKey(cell));
+                int axis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+                if(tMax[axis] > tExit)
+                {
+                    break;
+                }
+                cell[axis] += step[axis];
+                tMax[axis] += tDelta[axis];
+                if(cell[axis] < 0 || cell[axis] >= cellNum)
+                {
+                    break;
+                }
+            }
+
+            // A ray that was cut, or that leaves the root cube, is free up to where it stops.
+            if(!hit)
+            {
+                freeKeys.push_back(cellKey(last));
+            }
+        }
+    }
+
+    void OccupancyOctree::insertScan(const std::vector<Point3f>& points, const Point3f& sensorOrigin, float maxRange)
+    {
+        if(points.empty())
+        {
+            return;
+        }
+
+        const int pointNum = (int)points.size();
+        const int chunkNum = std::min(std::max(cv::getNumThreads(), 1) * 4, pointNum);
+        std::vector<std::vector<uint64> > chunkFreeKeys(chunkNum), chunkHitKeys(chunkNum);
+        parallel_for_(Range(0, chunkNum), [&](const Range& range)
+        {
+            for(int chunk = range.start; chunk < range.end; chunk++)
+            {
+                int first = (int)((int64)pointNum * chunk / chunkNum);
+                int last = (int)((int64)pointNum * (chunk + 1) / chunkNum);
+                traceRays(points.data() + first, last - first, sensorOrigin, maxRange,
+                          chunkFreeKeys[chunk], chunkHitKeys[chunk]);
+                sortUniqueKeys(chunkFreeKeys[chunk]);
+                sortUniqueKeys(chunkHitKeys[chunk]);
+            }
+        });
+
+        std::vector<uint64> freeKeys, hitKeys;
+        for(int chunk = 0; chunk < chunkNum; chunk++)
+        {
+            freeKeys.insert(freeKeys.end(), chunkFreeKeys[chunk].begin(), chunkFreeKeys[chunk].end());
+            hitKeys.insert(hitKeys.end(), chunkHitKeys[chunk].begin(), chunkHitKeys[chunk].end());
+            std::vector<uint64>().swap(chunkFreeKeys[chunk]);
+        }
+        sortUniqueKeys(freeKeys);
+        sortUniqueKeys(hitKeys);
+
+        // A hit wins over the rays crossing the same cell.
+        std::vector<uint64> missKeys;
+        missKeys.reserve(freeKeys.size());
+        std::set_difference(freeKeys.begin(), freeKeys.end(), hitKeys.begin(), hitKeys.end(),
+                            std::back_inserter(missKeys));
+
+        // The tree is only modified here, in Morton order, where consecutive cells share their paths.
+        std::vector<std::vector<OctreeNode*> > touched(maxDepth);
+        updateCells(missKeys, missLogOdds, touched);
+        updateCells(hitKeys, hitLogOdds, touched);
+        updateSummaries(touched);
+    }
+
+    bool OccupancyOctree::updateCell(const Point3f& point, bool occupied)
+    {
+        uint64 key;
+        if(computeMortonCodes(&point, 1, origin, size, maxDepth, &key) != 0)
+        {
+            return false;
+        }
+        std::vector<uint64> keys(1, key);
+        std::vector<std::vector<OctreeNode*> > touched(maxDepth);
+        updateCells(keys, occupied ? hitLogOdds : missLogOdds, touched);
+        updateSummaries(touched);
+        return true;
+    }
+
+    const OctreeNode* OccupancyOctree::search(const Point3f& point, int depth) const
+    {
+        uint64 key;
+        if(rootNode == nullptr || computeMortonCodes(&point, 1, origin, size, maxDepth, &key) != 0)
+        {
+            return nullptr;
+        }
+
+        const int maxSearchDepth = depth < 0 ? maxDepth : std::min(depth, maxDepth);
+        const OctreeNode* node = rootNode;
+        while(!node->isLeaf && node->depth < maxSearchDepth)
+        {
+            node = node->children[(key >> (3 * (maxDepth - node->depth - 1))) & 7];
+            if(node == nullptr)
+            {
+                return nullptr;
+            }
+        }
+        return node;
+    }
+
+    float OccupancyOctree::getOccupancy(const Point3f& point, int depth) const
+    {
+        const OctreeNode* node = search(point, depth);
+        return node == nullptr ? -1.f : getProbability(node);
+    }
+
+    bool OccupancyOctree::isOccupied(const Point3f& point, int depth) const
+    {
+        const OctreeNode* node = search(point, depth);
+        return node != nullptr && isNodeOccupied(node);
+    }
+
+    void OccupancyOctree::getOccupiedLeaves(std::vector<const OctreeNode*>& leaves) const
+    {
+        leaves.clear();
+        if(rootNode == nullptr)
+        {
+            return;
+        }
+
+        // With the max summary, the free subtrees are skipped at their root.
+        std::vector<const OctreeNode*> stack(1, rootNode);
+        while(!stack.empty())
+        {
+            const OctreeNode* node = stack.back();
+            stack.pop_back();
+            if(summaryMode == OCCUPANCY_SUMMARY_MAX && !isNodeOccupied(node))
+            {
+                continue;
+            }
+            if(node->isLeaf)
+            {
+                if(isNodeOccupied(node))
+                {
+                    leaves.push_back(node);
+                }
+                continue;
+            }
+            for(int childIndex = OctreeNode::childNum - 1; childIndex >= 0; childIndex--)
+            {
+                if(node->children[childIndex] != nullptr)
+                {
+                    stack.push_back(node->children[childIndex]);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,174 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#ifndef OPENCV_OCTREE_OCCUPANCY_OCTREE_H
+#define OPENCV_OCTREE_OCCUPANCY_OCTREE_H
+
+#include <vector>
+#include "octree.h"
+
+namespace cv {
+//! @addtogroup 3d
+//! @{
+
+    //! How an intermediate node of an OccupancyOctree summarizes its children.
+    enum OccupancySummaryMode
+    {
+        //! The most occupied child, an intermediate node is occupied if anything below it is.
+        OCCUPANCY_SUMMARY_MAX = 0,
+        //! The mean of the known children.
+        OCCUPANCY_SUMMARY_MEAN = 1
+    };
+
+    /** @brief Probabilistic occupancy map on an octree.
+    Every node carries the log-odds of occupancy of its cube in OctreeNode::logOdds, and no point: a scan is
+    integrated by tracing the ray from the sensor to every point at the resolution of maxDepth. The cells the rays
+    cross are updated as free and the cells of the points as occupied, with the hit and miss log-odds of the sensor
+    model, clamped so that the map keeps adapting to changes.
+
+    The unknown space has no node. An intermediate node holds the summary of its known children, see
+    OccupancySummaryMode, so coarse levels can be queried directly. Eight leaves with the same log-odds are pruned
+    into their parent after every update, which then is a leaf above maxDepth; clamping makes large free or occupied
+    regions uniform. The nodes are expanded again when a later update splits the region.
+    */
+    class CV_EXPORTS OccupancyOctree{
+
+    public:
+
+        /** @brief Create an empty map.
+         * @param _maxDepth Max depth, up to 21.
+         * @param _size Root cube size.
+         * @param _origin Root cube origin.
+         * @param _summaryMode The summary of the intermediate nodes, see OccupancySummaryMode.
+         */
+        OccupancyOctree(int _maxDepth, double _size, Point3f _origin, int _summaryMode = OCCUPANCY_SUMMARY_MAX);
+
+        OccupancyOctree(const OccupancyOctree&) = delete;
+        OccupancyOctree& operator=(const OccupancyOctree&) = delete;
+
+        //! destructor - calls clear()
+        ~OccupancyOctree();
+
+        /** @brief Set the probabilities of occupancy given to a cell by a single hit and by a single miss.
+         * The defaults are 0.7 and 0.4.
+         */
+        void setSensorModel(float probHit, float probMiss);
+
+        /** @brief Set the bounds of the probability of occupancy of a cell. The defaults are 0.12 and 0.97.
+         * The lower the certainty a cell can reach, the fewer updates it takes to change its state.
+         */
+        void setClampingThresholds(float probMin, float probMax);
+
+        //! Set the probability above which a node is occupied, 0.5 by default.
+        void setOccupancyThreshold(float prob);
+
+        /** @brief Integrate a range scan.
+         * The rays of the scan are traced on parallel threads, each cell is updated once per scan however many rays
+         * cross it, and a cell hit by a point is never updated as free by the same scan. The summaries are then
+         * updated bottom-up on the modified paths only. Points and rays out of the root cube are clipped to it.
+         * @param points The end points of the rays, they are not kept.
+         * @param sensorOrigin The position of the sensor.
+         * @param maxRange The rays longer than maxRange are cut and their end point not updated as occupied.
+         * A negative value disables the limit.
+         */
+        void insertScan(const std::vector<Point3f>& points, const Point3f& sensorOrigin, float maxRange = -1);
+
+        /** @brief Update the cell of a point with a single measurement.
+         * @param point The point.
+         * @param occupied Whether the cell was hit or seen free.
+         * @return false if the point is out of the root cube.
+         */
+        bool updateCell(const Point3f& point, bool occupied);
+
+        /** @brief Find the node containing a point.
+         * @param point The point.
+         * @param depth The deepest level to descend to, -1 for maxDepth. The summary of a coarse level is read
+         * from its intermediate nodes.
+         * @return The deepest known node containing the point down to depth, or NULL if the point is unknown.
+         */
+        const OctreeNode* search(const Point3f& point, int depth = -1) const;
+
+        //! The probability of occupancy of the cell of a point, see search(), or -1 if the point is unknown.
+        float getOccupancy(const Point3f& point, int depth = -1) const;
+
+        //! Whether the cell of a point is known and occupied, see search().
+        bool isOccupied(const Point3f& point, int depth = -1) const;
+
+        //! Whether a node of the map is occupied.
+        bool isNodeOccupied(const OctreeNode* node) const;
+
+        //! The log-odds of occupancy of a node of the map.
+        static float getLogOdds(const OctreeNode* node);
+
+        //! The probability of occupancy of a node of the map.
+        static float getProbability(const OctreeNode* node);
+
+        //! Collect the occupied leaves, pruned ones included.
+        void getOccupiedLeaves(std::vector<const OctreeNode*>& leaves) const;
+
+        //! The number of nodes of the map.
+        size_t getNodeCount() const;
+
+        //! Delete all the nodes. The root cube and the sensor model are kept.
+        void clear();
+
+        //! The root node of the map, NULL while it is empty.
+        OctreeNode* rootNode;
+
+        //! Max depth of the tree.
+        int maxDepth;
+
+        //! The size of the root cube.
+        double size;
+
+        //! The origin coordinate of the root cube.
+        Point3f origin;
+
+    private:
+
+        //! Owns the nodes.
+        Ptr<OctreeNodePool> nodePool;
+
+        int summaryMode;
+
+        //! The log-odds of the sensor model and of the thresholds, in the fixed point of OctreeNode::logOdds.
+        int hitLogOdds;
+        int missLogOdds;
+        int clampMin;
+        int clampMax;
+        int occupancyThreshold;
+
+        //! OctreeNode::logOdds is the log-odds times logOddsScale.
+        static const float logOddsScale;
+
+        //! Convert a probability to the fixed point log-odds.
+        static int toLogOdds(float prob);
+
+        //! Create the child childIndex of node, an unknown cell.
+        OctreeNode* createChild(OctreeNode* node, int childIndex, bool leaf);
+
+        //! Split a pruned leaf above maxDepth into eight leaves with its log-odds.
+        void expandNode(OctreeNode* node);
+
+        /** @brief Add delta to the log-odds of the cells of sorted Morton codes, creating and expanding nodes as
+         * needed. The parents of the updated cells and of the created nodes are appended to touched, by depth.
+         */
+        void updateCells(const std::vector<uint64>& keys, int delta, std::vector<std::vector<OctreeNode*> >& touched);
+
+        /** @brief Recompute the summary of an intermediate node, and prune its children if they are uniform leaves.
+         * @return Whether the node changed in a way its parent has to know.
+         */
+        bool updateSummary(OctreeNode* node);
+
+        //! Update the summaries of the touched nodes and of their ancestors, bottom-up. touched is left empty.
+        void updateSummaries(std::vector<std::vector<OctreeNode*> >& touched);
+
+        //! Append the Morton codes of the cells crossed by the rays of a scan, and of the cells hit by them.
+        void traceRays(const Point3f* points, size_t pointNum, const Point3f& sensorOrigin, float maxRange,
+                       std::vector<uint64>& freeKeys, std::vector<uint64>& hitKeys) const;
+    };
+//! @} 3d
+}
+
+#endif //OPENCV_OCTREE_OCCUPANCY_OCTREE_H
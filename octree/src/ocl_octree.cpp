@@ -0,0 +1,461 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <cmath>
+#include <limits>
+#include "ocl_octree.h"
+#include "morton.h"
+
+#ifdef OCTREE_WITH_OPENCL
+#include "opencv2/core/ocl.hpp"
+#endif
+
+namespace cv{
+
+#ifdef OCTREE_WITH_OPENCL
+
+    // The kernels follow the CPU code: the Morton codes of computeMortonCodes, a sort on (code, index) pairs which
+    // is the order of the stable radixSortMorton, and the pruning of Octree::KNNSearchImpl. Contraction is disabled
+    // so that the codes and the distances are rounded as on the CPU.
+    static const char* const octreeKernels = R"CLC(
+#pragma OPENCL FP_CONTRACT OFF
+
+inline ulong expandMortonBits(ulong v)
+{
+    v &= 0x1fffffUL;
+    v = (v | v << 32) & 0x1f00000000ffffUL;
+    v = (v | v << 16) & 0x1f0000ff0000ffUL;
+    v = (v | v << 8) & 0x100f00f00f00f00fUL;
+    v = (v | v << 4) & 0x10c30c30c30c30c3UL;
+    v = (v | v << 2) & 0x1249249249249249UL;
+    return v;
+}
+
+// keys and indices are padded to a power of two, the padding sorts after every point.
+__kernel void octree_morton(__global const float* points, int pointNum, float originX, float originY, float originZ,
+                            float upperX, float upperY, float upperZ, float scale, int cellMax,
+                            __global ulong* keys, __global int* indices, __global int* outsideNum)
+{
+    int i = get_global_id(0);
+    indices[i] = i;
+    if(i >= pointNum)
+    {
+        keys[i] = 0xffffffffffffffffUL;
+        return;
+    }
+
+    float3 p = vload3(i, points);
+    if(!(p.x >= originX && p.x <= upperX && p.y >= originY && p.y <= upperY && p.z >= originZ && p.z <= upperZ))
+    {
+        atomic_inc(outsideNum);
+    }
+    // Clamped before the conversion like on the CPU, fmax turns a NaN into 0.
+    int x = (int)fmin(fmax((p.x - originX) * scale, 0.f), (float)cellMax);
+    int y = (int)fmin(fmax((p.y - originY) * scale, 0.f), (float)cellMax);
+    int z = (int)fmin(fmax((p.z - originZ) * scale, 0.f), (float)cellMax);
+    keys[i] = expandMortonBits(x) | (expandMortonBits(y) << 1) | (expandMortonBits(z) << 2);
+}
+
+// One compare and swap step of a bitonic sort on (key, index) pairs.
+__kernel void octree_bitonic_step(__global ulong* keys, __global int* indices, int stride, int blockSize)
+{
+    int i = get_global_id(0);
+    int j = i ^ stride;
+    if(j <= i)
+    {
+        return;
+    }
+    ulong keyI = keys[i], keyJ = keys[j];
+    int indexI = indices[i], indexJ = indices[j];
+    bool greater = keyI > keyJ || (keyI == keyJ && indexI > indexJ);
+    if(greater == ((i & blockSize) == 0))
+    {
+        keys[i] = keyJ;
+        keys[j] = keyI;
+        indices[i] = indexJ;
+        indices[j] = indexI;
+    }
+}
+
+inline float squareDistToBox(float3 p, float4 box)
+{
+    float dx = fmax(fmax(box.x - p.x, p.x - (box.x + box.w)), 0.f);
+    float dy = fmax(fmax(box.y - p.y, p.y - (box.y + box.w)), 0.f);
+    float dz = fmax(fmax(box.z - p.z, p.z - (box.z + box.w)), 0.f);
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// The K nearest points within squareRadius of every query, sorted in the output rows. A node is a leaf when it has
+// no child, nodeLinks holds (first child, child mask, point offset, point count).
+__kernel void octree_search(__global const float4* nodeBoxes, __global const int4* nodeLinks,
+                            __global const float* points, __global const float* queries, int queryNum, int K,
+                            float squareRadius, __global float* outPoints, __global float* outDists,
+                            __global int* outCounts, int withCounts)
+{
+    int q = get_global_id(0);
+    if(q >= queryNum)
+    {
+        return;
+    }
+
+    float3 query = vload3(q, queries);
+    __global float* dists = outDists + (size_t)q * K;
+    __global float* found = outPoints + (size_t)q * K * 3;
+    int count = 0;
+    float bound = squareRadius;
+
+    int stack[OCTREE_STACK_SIZE];
+    float stackDists[OCTREE_STACK_SIZE];
+    stack[0] = 0;
+    stackDists[0] = squareDistToBox(query, nodeBoxes[0]);
+    int top = 1;
+    while(top > 0)
+    {
+        top--;
+        int node = stack[top];
+        if(stackDists[top] > bound)
+        {
+            continue;
+        }
+
+        int4 link = nodeLinks[node];
+        if(link.y == 0)
+        {
+            for(int i = link.z; i < link.z + link.w; i++)
+            {
+                float3 p = vload3(i, points);
+                float3 d = query - p;
+                float dist = d.x * d.x + d.y * d.y + d.z * d.z;
+                if(dist > bound || (count == K && dist >= dists[K - 1]))
+                {
+                    continue;
+                }
+                int pos = count < K ? count++ : K - 1;
+                for(; pos > 0 && dists[pos - 1] > dist; pos--)
+                {
+                    dists[pos] = dists[pos - 1];
+                    vstore3(vload3(pos - 1, found), pos, found);
+                }
+                dists[pos] = dist;
+                vstore3(p, pos, found);
+                if(count == K)
+                {
+                    bound = fmin(bound, dists[K - 1]);
+                }
+            }
+            continue;
+        }
+
+        // Push the children furthest first, so that the closest one is visited next.
+        int childNodes[8];
+        float childDists[8];
+        int childNum = 0;
+        int child = link.x;
+        for(int c = 0; c < 8; c++)
+        {
+            if((link.y & (1 << c)) == 0)
+            {
+                continue;
+            }
+            float dist = squareDistToBox(query, nodeBoxes[child]);
+            if(dist <= bound)
+            {
+                int pos = childNum++;
+                for(; pos > 0 && childDists[pos - 1] < dist; pos--)
+                {
+                    childDists[pos] = childDists[pos - 1];
+                    childNodes[pos] = childNodes[pos - 1];
+                }
+                childDists[pos] = dist;
+                childNodes[pos] = child;
+            }
+            child++;
+        }
+        for(int c = 0; c < childNum; c++)
+        {
+            stack[top] = childNodes[c];
+            stackDists[top] = childDists[c];
+            top++;
+        }
+    }
+
+    for(int k = count; k < K; k++)
+    {
+        dists[k] = INFINITY;
+        vstore3((float3)(0.f, 0.f, 0.f), k, found);
+    }
+    if(withCounts)
+    {
+        outCounts[q] = count;
+    }
+}
+)CLC";
+
+    static const ocl::ProgramSource& octreeProgramSource()
+    {
+        static ocl::ProgramSource source(octreeKernels);
+        return source;
+    }
+
+    //! Make a continuous CV_32FC3 UMat starting at its buffer, as the kernels take plain pointers.
+    static UMat getDevicePoints(InputArray points)
+    {
+        CV_Assert(points.type() == CV_32FC3 || (points.depth() == CV_32F && points.channels() == 1 &&
+                                                points.total() % 3 == 0));
+        UMat u = points.getUMat();
+        if(!u.isContinuous() || u.offset != 0)
+        {
+            u = u.clone();
+        }
+        return u.reshape(3, (int)(u.total() * u.channels() / 3));
+    }
+
+#endif
+
+    bool oclSortMortonCodes(const Point3f* points, size_t pointNum, const Point3f& origin, double size, int maxDepth,
+                            uint64* keys, int* indices, size_t& outsideNum)
+    {
+#ifdef OCTREE_WITH_OPENCL
+        if(!ocl::useOpenCL() || pointNum == 0 || pointNum > (size_t)std::numeric_limits<int>::max() / 2)
+        {
+            return false;
+        }
+        CV_Assert(maxDepth >= 0 && maxDepth <= MORTON_MAX_DEPTH);
+
+        int paddedNum = 1;
+        while(paddedNum < (int)pointNum)
+        {
+            paddedNum <<= 1;
+        }
+
+        // The upper faces rounded up, like in computeMortonCodes.
+        const double upperBound[3] = {origin.x + size, origin.y + size, origin.z + size};
+        float upper[3];
+        for(int axis = 0; axis < 3; axis++)
+        {
+            upper[axis] = (float)upperBound[axis];
+            if((double)upper[axis] < upperBound[axis])
+            {
+                upper[axis] = std::nextafter(upper[axis], std::numeric_limits<float>::infinity());
+            }
+        }
+
+        UMat devicePoints;
+        Mat((int)pointNum, 1, CV_32FC3, const_cast<Point3f*>(points)).copyTo(devicePoints);
+        // There is no 64-bit unsigned type, the codes are stored as pairs of 32-bit integers.
+        UMat deviceKeys(1, paddedNum, CV_32SC2), deviceIndices(1, paddedNum, CV_32S);
+        UMat deviceOutside = UMat::zeros(1, 1, CV_32S);
+
+        ocl::Kernel morton("octree_morton", octreeProgramSource());
+        if(morton.empty())
+        {
+            return false;
+        }
+        morton.args(ocl::KernelArg::PtrReadOnly(devicePoints), (int)pointNum, origin.x, origin.y, origin.z,
+                    upper[0], upper[1], upper[2], (float)((1 << maxDepth) / size), (1 << maxDepth) - 1,
+                    ocl::KernelArg::PtrWriteOnly(deviceKeys), ocl::KernelArg::PtrWriteOnly(deviceIndices),
+                    ocl::KernelArg::PtrReadWrite(deviceOutside));
+        size_t globalSize = (size_t)paddedNum;
+        if(!morton.run(1, &globalSize, nullptr, false))
+        {
+            return false;
+        }
+
+        ocl::Kernel step("octree_bitonic_step", octreeProgramSource());
+        if(step.empty())
+        {
+            return false;
+        }
+        for(int blockSize = 2; blockSize <= paddedNum; blockSize <<= 1)
+        {
+            for(int stride = blockSize >> 1; stride > 0; stride >>= 1)
+            {
+                step.args(ocl::KernelArg::PtrReadWrite(deviceKeys), ocl::KernelArg::PtrReadWrite(deviceIndices),
+                          stride, blockSize);
+                if(!step.run(1, &globalSize, nullptr, false))
+                {
+                    return false;
+                }
+            }
+        }
+
+        Mat hostKeys(1, (int)pointNum, CV_32SC2, keys), hostIndices(1, (int)pointNum, CV_32S, indices);
+        deviceKeys.colRange(0, (int)pointNum).copyTo(hostKeys);
+        deviceIndices.colRange(0, (int)pointNum).copyTo(hostIndices);
+        outsideNum = (size_t)deviceOutside.getMat(ACCESS_READ).at<int>(0);
+        return true;
+#else
+        CV_UNUSED(points); CV_UNUSED(pointNum); CV_UNUSED(origin); CV_UNUSED(size); CV_UNUSED(maxDepth);
+        CV_UNUSED(keys); CV_UNUSED(indices); CV_UNUSED(outsideNum);
+        return false;
+#endif
+    }
+
+    OclOctree::OclOctree():maxDepth(0)
+    {
+    }
+
+    bool OclOctree::isAvailable()
+    {
+#ifdef OCTREE_WITH_OPENCL
+        return ocl::useOpenCL();
+#else
+        return false;
+#endif
+    }
+
+    bool OclOctree::upload(const Octree& tree)
+    {
+        release();
+        if(!isAvailable())
+        {
+            return false;
+        }
+        if(tree.rootNode == nullptr)
+        {
+            return true;
+        }
+        CV_Assert(tree.maxDepth >= 0 && tree.maxDepth <= MORTON_MAX_DEPTH);
+
+        // Breadth-first, the children of a node are appended together, in child order.
+        std::vector<const OctreeNode*> nodes(1, tree.rootNode);
+        std::vector<Vec4f> boxes;
+        std::vector<Vec4i> links;
+        std::vector<Point3f> leafPoints;
+        for(size_t i = 0; i < nodes.size(); i++)
+        {
+            const OctreeNode* node = nodes[i];
+            Vec4i link;
+            if(node->isLeaf)
+            {
+                link[2] = (int)leafPoints.size();
+                if(tree.isCompact())
+                {
+                    const Point3f* first = tree.getLeafPoints(node);
+                    leafPoints.insert(leafPoints.end(), first, first + node->pointCount);
+                }
+                else
+                {
+                    for(const Point3f* point : node->pointList)
+                    {
+                        leafPoints.push_back(*point);
+                    }
+                }
+                link[3] = (int)leafPoints.size() - link[2];
+            }
+            else
+            {
+                link[0] = (int)nodes.size();
+                for(int childIndex = 0; childIndex < OctreeNode::childNum; childIndex++)
+                {
+                    if(node->children[childIndex] != nullptr)
+                    {
+                        link[1] |= 1 << childIndex;
+                        nodes.push_back(node->children[childIndex]);
+                    }
+                }
+            }
+            boxes.push_back(Vec4f(node->origin.x, node->origin.y, node->origin.z, (float)node->size));
+            links.push_back(link);
+        }
+
+        Mat(boxes).copyTo(nodeBoxes);
+        Mat(links).copyTo(nodeLinks);
+        if(leafPoints.empty())
+        {
+            points.create(0, 1, CV_32FC3);
+        }
+        else
+        {
+            Mat(leafPoints).copyTo(points);
+        }
+        maxDepth = tree.maxDepth;
+        return true;
+    }
+
+    void OclOctree::KNNSearch(InputArray queries, int K, OutputArray _points, OutputArray squareDists) const
+    {
+        CV_Assert(K > 0);
+        search(queries, K, std::numeric_limits<float>::infinity(), _points, squareDists, noArray());
+    }
+
+    void OclOctree::radiusNNSearch(InputArray queries, float radius, int maxResults, OutputArray _points,
+                                   OutputArray squareDists, OutputArray counts) const
+    {
+        CV_Assert(maxResults > 0 && radius >= 0);
+        search(queries, maxResults, radius * radius, _points, squareDists, counts);
+    }
+
+    void OclOctree::search(InputArray queries, int K, float squareRadius, OutputArray _points,
+                           OutputArray squareDists, OutputArray counts) const
+    {
+#ifdef OCTREE_WITH_OPENCL
+        CV_Assert(isAvailable());
+        UMat deviceQueries = getDevicePoints(queries);
+        const int queryNum = deviceQueries.rows;
+        _points.create(queryNum, K, CV_32FC3);
+        squareDists.create(queryNum, K, CV_32F);
+        if(counts.needed())
+        {
+            counts.create(queryNum, 1, CV_32S);
+        }
+        if(queryNum == 0)
+        {
+            return;
+        }
+
+        // The kernels write the outputs through plain pointers.
+        UMat outPoints = _points.getUMat(), outDists = squareDists.getUMat();
+        UMat outCounts = counts.needed() ? counts.getUMat() : UMat(1, 1, CV_32S);
+        CV_Assert(outPoints.isContinuous() && outPoints.offset == 0 && outDists.isContinuous() &&
+                  outDists.offset == 0 && outCounts.isContinuous() && outCounts.offset == 0);
+        if(empty() || points.empty())
+        {
+            outPoints.setTo(Scalar::all(0));
+            outDists.setTo(Scalar::all(std::numeric_limits<float>::infinity()));
+            outCounts.setTo(Scalar::all(0));
+            return;
+        }
+
+        // A node pushes at most 8 children and pops itself, on each of the maxDepth levels.
+        ocl::Kernel kernel("octree_search", octreeProgramSource(),
+                           format("-D OCTREE_STACK_SIZE=%d", 7 * maxDepth + 8));
+        if(kernel.empty())
+        {
+            CV_Error(Error::OpenCLApiCallError, "The octree search kernel can not be built!");
+        }
+        kernel.args(ocl::KernelArg::PtrReadOnly(nodeBoxes), ocl::KernelArg::PtrReadOnly(nodeLinks),
+                    ocl::KernelArg::PtrReadOnly(points), ocl::KernelArg::PtrReadOnly(deviceQueries), queryNum, K,
+                    squareRadius, ocl::KernelArg::PtrWriteOnly(outPoints), ocl::KernelArg::PtrWriteOnly(outDists),
+                    ocl::KernelArg::PtrWriteOnly(outCounts), counts.needed() ? 1 : 0);
+        size_t globalSize = (size_t)queryNum;
+        if(!kernel.run(1, &globalSize, nullptr, false))
+        {
+            CV_Error(Error::OpenCLApiCallError, "The octree search kernel failed!");
+        }
+#else
+        CV_UNUSED(queries); CV_UNUSED(K); CV_UNUSED(squareRadius); CV_UNUSED(_points); CV_UNUSED(squareDists);
+        CV_UNUSED(counts);
+        CV_Error(Error::StsNotImplemented, "The octree is built without OCTREE_WITH_OPENCL!");
+#endif
+    }
+
+    const UMat& OclOctree::getPoints() const
+    {
+        return points;
+    }
+
+    bool OclOctree::empty() const
+    {
+        return nodeBoxes.empty();
+    }
+
+    void OclOctree::release()
+    {
+        nodeBoxes.release();
+        nodeLinks.release();
+        points.release();
+        maxDepth = 0;
+    }
+}
@@ -0,0 +1,94 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#ifndef OPENCV_OCTREE_OCL_OCTREE_H
+#define OPENCV_OCTREE_OCL_OCTREE_H
+
+#include "octree.h"
+
+namespace cv {
+//! @addtogroup 3d
+//! @{
+
+    /** @brief A read-only copy of an Octree on the OpenCL device of cv::ocl, for batched queries on the device.
+    The nodes are uploaded as flat arrays in breadth-first order, where the children of a node are contiguous, and
+    the points in leaf order. Every query is run by one work item, which walks the nodes closest first with a stack.
+    The queries and the results are UMat, so that a pipeline can keep them on the device from one kernel to the
+    next. The tree itself is built on the host, see OCTREE_BUILD_OPENCL to sort its Morton codes on the device.
+
+    The backend needs the OCTREE_WITH_OPENCL build option and OpenCV built with OpenCL. Otherwise isAvailable()
+    returns false, upload() fails and the queries raise an error.
+    */
+    class CV_EXPORTS OclOctree{
+
+    public:
+
+        //! Create an empty device tree, see upload().
+        OclOctree();
+
+        //! Whether the OpenCL backend is built and an OpenCL device is in use, see cv::ocl::useOpenCL().
+        static bool isAvailable();
+
+        /** @brief Copy a tree to the device, replacing the previous one.
+         * The device tree does not follow later modifications of tree, upload it again after them.
+         * @param tree The tree, with a maxDepth up to 21.
+         * @return false if the backend is not available.
+         */
+        bool upload(const Octree& tree);
+
+        /** @brief K nearest neighbor search for a batch of query points, on the device.
+         * The results are the same as the batched Octree::KNNSearch().
+         * @param queries The query points, a UMat, Mat or std::vector<Point3f> of CV_32FC3.
+         * @param K The number of neighbors to search.
+         * @param points Output, a queries x K CV_32FC3 matrix, row i holds the neighbors of queries[i], sorted by
+         * distance in ascending order. Pass a UMat to keep it on the device.
+         * @param squareDists Output, a queries x K CV_32F matrix of the squared distances. When the tree holds less
+         * than K points, the missing neighbors have an infinite distance.
+         */
+        void KNNSearch(InputArray queries, int K, OutputArray points, OutputArray squareDists) const;
+
+        /** @brief Radius search for a batch of query points, on the device.
+         * Every query keeps its maxResults nearest points within radius, so the output has a fixed size.
+         * @param queries The query points, see KNNSearch().
+         * @param radius Retrieved radius value.
+         * @param maxResults The number of points kept per query.
+         * @param points Output, a queries x maxResults CV_32FC3 matrix, sorted by distance in ascending order.
+         * @param squareDists Output, a queries x maxResults CV_32F matrix, infinity after the points found.
+         * @param counts Output, a queries x 1 CV_32S matrix, the number of points found for every query, up to
+         * maxResults.
+         */
+        void radiusNNSearch(InputArray queries, float radius, int maxResults, OutputArray points,
+                            OutputArray squareDists, OutputArray counts) const;
+
+        //! The points of the tree in leaf order, a pointNum x 1 CV_32FC3 matrix on the device.
+        const UMat& getPoints() const;
+
+        //! returns true if no tree is uploaded.
+        bool empty() const;
+
+        //! Release the device buffers.
+        void release();
+
+    private:
+
+        //! The origin and the size of the cube of every node.
+        UMat nodeBoxes;
+
+        //! The first child, the child mask, the point offset and the point count of every node, CV_32SC4.
+        UMat nodeLinks;
+
+        //! See getPoints().
+        UMat points;
+
+        //! Max depth of the uploaded tree, which bounds the traversal stack.
+        int maxDepth;
+
+        //! Run the search kernel, see KNNSearch() and radiusNNSearch().
+        void search(InputArray queries, int K, float squareRadius, OutputArray points, OutputArray squareDists,
+                    OutputArray counts) const;
+    };
+//! @} 3d
+}
+
+#endif //OPENCV_OCTREE_OCL_OCTREE_H
@@ -2,341 +2,2307 @@
 // It is subject to the license terms in the LICENSE file found in the top-level directory
 // of this distribution and at http://opencv.org/license.html
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <queue>
 #include <vector>
 #include "octree.h"
+#include "mapped_file.h"
+#include "morton.h"
+#include "octree_distance.h"
 #include "opencv2/core.hpp"
+#include "opencv2/core/hal/intrin.hpp"
 
 namespace cv{
 
-    OctreeNode::OctreeNode(int _depth, double _size, Point3f _origin, int _parentIndex):children(8),depth(_depth),size(_size),origin(
+#ifdef OCTREE_ENABLE_QUERY_STATS
+    static OctreeQueryStats& threadQueryStats()
+    {
+        static thread_local OctreeQueryStats stats;
+        return stats;
+    }
+
+    static void addQueryStats(OctreeQueryStats& dst, const OctreeQueryStats& src)
+    {
+        dst.queries += src.queries;
+        dst.nodesVisited += src.nodesVisited;
+        dst.boundTests += src.boundTests;
+        dst.leafPointsScanned += src.leafPointsScanned;
+    }
+
+    //! Collects the counters of the workers of a parallel query, and adds them to the calling thread at the end.
+    class ParallelQueryStats
+    {
+    public:
+        ~ParallelQueryStats()
+        {
+            addQueryStats(threadQueryStats(), total);
+        }
+
+        //! Held by a worker for its whole chunk. Its counts are moved out of the worker thread, which may be the
+        //! calling thread itself.
+        class Worker
+        {
+        public:
+            explicit Worker(ParallelQueryStats& _owner):owner(_owner), start(threadQueryStats())
+            {
+                threadQueryStats() = OctreeQueryStats();
+            }
+
+            ~Worker()
+            {
+                std::lock_guard<std::mutex> lock(owner.mutex);
+                addQueryStats(owner.total, threadQueryStats());
+                threadQueryStats() = start;
+            }
+
+        private:
+            ParallelQueryStats& owner;
+            OctreeQueryStats start;
+        };
+
+    private:
+        std::mutex mutex;
+        OctreeQueryStats total;
+    };
+
+#define OCTREE_QUERY_STAT(counter, n) (threadQueryStats().counter += (n))
+#define OCTREE_PARALLEL_QUERY_STATS(name) ParallelQueryStats name
+#define OCTREE_WORKER_QUERY_STATS(name) ParallelQueryStats::Worker name##Worker(name)
+#else
+#define OCTREE_QUERY_STAT(counter, n) ((void)0)
+#define OCTREE_PARALLEL_QUERY_STATS(name)
+#define OCTREE_WORKER_QUERY_STATS(name)
+#endif
+
+    //! Grow [minBound, maxBound] to the points of a block, a SIMD register at a time.
+    static void boundingBoxOfBlock(const Point3f* points, size_t pointNum, Point3f& minBound, Point3f& maxBound)
+    {
+        size_t i = 0;
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+        const int lanes = VTraits<v_float32>::vlanes();
+        if(pointNum >= (size_t)lanes)
+        {
+            v_float32 minX = vx_setall_f32(minBound.x), minY = vx_setall_f32(minBound.y), minZ = vx_setall_f32(minBound.z);
+            v_float32 maxX = vx_setall_f32(maxBound.x), maxY = vx_setall_f32(maxBound.y), maxZ = vx_setall_f32(maxBound.z);
+            for(; i + lanes <= pointNum; i += lanes)
+            {
+                v_float32 x, y, z;
+                v_load_deinterleave(&points[i].x, x, y, z);
+                minX = v_min(minX, x);
+                minY = v_min(minY, y);
+                minZ = v_min(minZ, z);
+                maxX = v_max(maxX, x);
+                maxY = v_max(maxY, y);
+                maxZ = v_max(maxZ, z);
+            }
+            minBound = Point3f(v_reduce_min(minX), v_reduce_min(minY), v_reduce_min(minZ));
+            maxBound = Point3f(v_reduce_max(maxX), v_reduce_max(maxY), v_reduce_max(maxZ));
+        }
+        vx_cleanup();
+#endif
+
+        for(; i < pointNum; i++)
+        {
+            minBound.x = std::min(minBound.x, points[i].x);
+            minBound.y = std::min(minBound.y, points[i].y);
+            minBound.z = std::min(minBound.z, points[i].z);
+            maxBound.x = std::max(maxBound.x, points[i].x);
+            maxBound.y = std::max(maxBound.y, points[i].y);
+            maxBound.z = std::max(maxBound.z, points[i].z);
+        }
+    }
+
+    /** @brief The squared distances from the point to the 8 child cubes of the node, in child order.
+     * The children need not exist, their cubes are derived from the node like in insertPointRecurse.
+     */
+    static inline void squareDistToChildren(const Point3f& point, const OctreeNode* node, float* squareDists)
+    {
+        const float half = (float)(node->size / 2.0);
+        const Point3f& o = node->origin;
+
+#if CV_SIMD128
+        // Lane i holds child i, and child i + 4 only differs by its z range.
+        v_float32x4 lowX = v_add(v_setall_f32(o.x), v_float32x4(0, half, 0, half));
+        v_float32x4 lowY = v_add(v_setall_f32(o.y), v_float32x4(0, 0, half, half));
+        v_float32x4 vHalf = v_setall_f32(half), zero = v_setall_f32(0);
+        v_float32x4 px = v_setall_f32(point.x), py = v_setall_f32(point.y);
+        v_float32x4 dx = v_max(v_max(v_sub(lowX, px), v_sub(px, v_add(lowX, vHalf))), zero);
+        v_float32x4 dy = v_max(v_max(v_sub(lowY, py), v_sub(py, v_add(lowY, vHalf))), zero);
+        v_float32x4 dxy = v_add(v_mul(dx, dx), v_mul(dy, dy));
+
+        float lowZ = o.z + half;
+        float dz0 = std::max(std::max(o.z - point.z, point.z - (o.z + half)), 0.f);
+        float dz1 = std::max(std::max(lowZ - point.z, point.z - (lowZ + half)), 0.f);
+        v_store(squareDists, v_add(dxy, v_setall_f32(dz0 * dz0)));
+        v_store(squareDists + 4, v_add(dxy, v_setall_f32(dz1 * dz1)));
+#else
+        for(int childIndex = 0; childIndex < 8; childIndex++)
+        {
+            Point3f low(o.x + ((childIndex & 1) ? half : 0.f),
+                        o.y + ((childIndex & 2) ? half : 0.f),
+                        o.z + ((childIndex & 4) ? half : 0.f));
+            float dx = std::max(std::max(low.x - point.x, point.x - (low.x + half)), 0.f);
+            float dy = std::max(std::max(low.y - point.y, point.y - (low.y + half)), 0.f);
+            float dz = std::max(std::max(low.z - point.z, point.z - (low.z + half)), 0.f);
+            squareDists[childIndex] = dx * dx + dy * dy + dz * dz;
+        }
+#endif
+    }
+
+
+    OctreeNode::OctreeNode(int _depth, double _size, Point3f _origin, int _parentIndex):depth(_depth),size(_size),origin(
             _origin),parentIndex(_parentIndex)
     {
+        children.fill(nullptr);
     }
 
     void OctreeNode::clear()
     {
-        if(isLeaf)
+        if(pool != nullptr && parentIndex == -1)
+        {
+            // The whole tree lives in the pool, drop it at once.
+            pool->reset();
+            return;
+        }
+        if(parentIndex != -1 && parent == nullptr)
+        {
+            // A leaf of a HashedOctree, the table owns it.
+            return;
+        }
+
+        if(!isLeaf)
         {
-            if(parentIndex != -1)
+            for(int i = 0; i<childNum;i++)
             {
-                parent->children[parentIndex] = nullptr;
+                if(children[i] != nullptr)
+                {
+                    children[i]->clear();
+                }
             }
+        }
+
+        if(parentIndex != -1)
+        {
+            parent->children[parentIndex] = nullptr;
+        }
+
+        if(pool != nullptr)
+        {
+            pool->release(this);
+        }
+        else
+        {
             delete this;
         }
+    }
+
+    OctreeNode* OctreeNodePool::allocate(int _depth, double _size, Point3f _origin, int _parentIndex)
+    {
+        OctreeNode* node;
+        if(!freeList.empty())
+        {
+            node = freeList.back();
+            freeList.pop_back();
+        }
         else
         {
-            for(int i = 0; i<childNum;i++)
+            if(usedBlocks == 0 || blockUsed == blockSize)
             {
-                if(children[i] != nullptr)
+                if(usedBlocks == blocks.size())
+                {
+                    blocks.emplace_back(new OctreeNode[blockSize]);
+                }
+                usedBlocks++;
+                blockUsed = 0;
+            }
+            node = &blocks[usedBlocks - 1][blockUsed++];
+        }
+        liveCount++;
+
+        // Recycled nodes keep their pointList capacity.
+        node->children.fill(nullptr);
+        node->parent = nullptr;
+        node->parentIndex = _parentIndex;
+        node->depth = _depth;
+        node->size = _size;
+        node->origin = _origin;
+        node->isLeaf = false;
+        node->logOdds = 0;
+        node->pointList.clear();
+        node->pointOffset = 0;
+        node->pointCount = 0;
+        node->hash = 0;
+        if(node->aggregate)
+        {
+            node->aggregate->valid = false;
+        }
+        node->pool = owner;
+        return node;
+    }
+
+    void OctreeNodePool::release(OctreeNode* node)
+    {
+        CV_Assert(node->pool == owner);
+        freeList.push_back(node);
+        liveCount--;
+    }
+
+    void OctreeNodePool::reset()
+    {
+        usedBlocks = 0;
+        blockUsed = 0;
+        liveCount = 0;
+        freeList.clear();
+    }
+
+    void OctreeNodePool::merge(OctreeNodePool& src)
+    {
+        CV_Assert(src.owner == this && &src != this);
+
+        // Slot the filled blocks of src in front of our partially filled block, so that allocation carries on
+        // from where it was. The free tail of the last block of src is only recovered by the next reset().
+        size_t insertPos = usedBlocks == 0 ? 0 : usedBlocks - 1;
+        blocks.insert(blocks.begin() + insertPos,
+                      std::make_move_iterator(src.blocks.begin()),
+                      std::make_move_iterator(src.blocks.begin() + src.usedBlocks));
+        if(usedBlocks == 0 && src.usedBlocks != 0)
+        {
+            blockUsed = blockSize;
+        }
+        usedBlocks += src.usedBlocks;
+        blocks.insert(blocks.end(),
+                      std::make_move_iterator(src.blocks.begin() + src.usedBlocks),
+                      std::make_move_iterator(src.blocks.end()));
+        freeList.insert(freeList.end(), src.freeList.begin(), src.freeList.end());
+        liveCount += src.liveCount;
+
+        src.blocks.clear();
+        src.reset();
+    }
+
+    size_t OctreeNodePool::nodeCount() const
+    {
+        return liveCount;
+    }
+
+    size_t OctreeNodePool::capacityBytes() const
+    {
+        return blocks.size() * blockSize * sizeof(OctreeNode);
+    }
+
+    Octree::Octree(int _maxDepth, double _size, Point3f _origin ):maxDepth(_maxDepth),size(_size),origin(_origin),
+            nodePool(makePtr<OctreeNodePool>())
+    {
+    }
+
+    Octree::Octree(int _maxDepth, std::vector<Point3f>& _pointCloud, int flags):maxDepth(_maxDepth),size(0),
+            nodePool(makePtr<OctreeNodePool>())
+    {
+        convertFromPointCloud(_pointCloud, flags);
+    }
+
+    Octree::Octree(int _maxDepth):maxDepth(_maxDepth), size(0), origin(0,0,0), nodePool(makePtr<OctreeNodePool>())
+    {
+    }
+
+    Octree::Octree(const Octree& src):size(src.size), maxDepth(src.maxDepth), origin(src.origin),
+            nodePool(makePtr<OctreeNodePool>()), compact(src.compact), autoExpand(src.autoExpand),
+            boundPadding(src.boundPadding), leafCapacity(src.leafCapacity), compactPoints(src.compactPoints),
+            compactIndices(src.compactIndices), mappedFile(src.mappedFile), attributeCloud(src.attributeCloud),
+            attributeData(src.attributeData), attributePointNum(src.attributePointNum), attributeNum(src.attributeNum)
+    {
+        if(mappedFile)
+        {
+            compactPointData = src.compactPointData;
+            compactIndexData = src.compactIndexData;
+        }
+        else
+        {
+            compactPointData = compactPoints.data();
+            compactIndexData = compactIndices.data();
+        }
+
+        if(src.rootNode != nullptr)
+        {
+            rootNode = nodePool->allocate(src.rootNode->depth, src.rootNode->size, src.rootNode->origin, -1);
+            copyNodeRecurse(src.rootNode, rootNode);
+        }
+    }
+
+    Octree::Octree(Octree&& src) noexcept:size(0), maxDepth(0), origin(0,0,0)
+    {
+        // The nodes, the pool and the buffers the leaves refer to all change hands, nothing is reallocated.
+        swap(src);
+    }
+
+    Octree& Octree::operator=(const Octree& src)
+    {
+        if(this != &src)
+        {
+            Octree copy(src);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    Octree& Octree::operator=(Octree&& src) noexcept
+    {
+        if(this != &src)
+        {
+            Octree moved(std::move(src));
+            swap(moved);
+        }
+        return *this;
+    }
+
+    void Octree::swap(Octree& other) noexcept
+    {
+        std::swap(rootNode, other.rootNode);
+        std::swap(size, other.size);
+        std::swap(maxDepth, other.maxDepth);
+        std::swap(origin, other.origin);
+        std::swap(nodePool, other.nodePool);
+        std::swap(compact, other.compact);
+        std::swap(autoExpand, other.autoExpand);
+        std::swap(boundPadding, other.boundPadding);
+        std::swap(leafCapacity, other.leafCapacity);
+        compactPoints.swap(other.compactPoints);
+        compactIndices.swap(other.compactIndices);
+        std::swap(compactPointData, other.compactPointData);
+        std::swap(compactIndexData, other.compactIndexData);
+        std::swap(mappedFile, other.mappedFile);
+        leafIndices.swap(other.leafIndices);
+        adjacencyOffsets.swap(other.adjacencyOffsets);
+        adjacentLeaves.swap(other.adjacentLeaves);
+        std::swap(attributeCloud, other.attributeCloud);
+        std::swap(attributeData, other.attributeData);
+        std::swap(attributePointNum, other.attributePointNum);
+        std::swap(attributeNum, other.attributeNum);
+    }
+
+    OctreeNodePool& Octree::getNodePool()
+    {
+        if(!nodePool)
+        {
+            nodePool = makePtr<OctreeNodePool>();
+        }
+        return *nodePool;
+    }
+
+    void Octree::copyNodeRecurse(const OctreeNode* src, OctreeNode* node)
+    {
+        node->isLeaf = src->isLeaf;
+        node->logOdds = src->logOdds;
+        node->pointList = src->pointList;
+        node->pointOffset = src->pointOffset;
+        node->pointCount = src->pointCount;
+        node->hash = src->hash;
+
+        for(int childIndex = 0; childIndex < childNum; childIndex++)
+        {
+            const OctreeNode* srcChild = src->children[childIndex];
+            if(srcChild != nullptr)
+            {
+                OctreeNode* child = nodePool->allocate(srcChild->depth, srcChild->size, srcChild->origin, childIndex);
+                child->parent = node;
+                node->children[childIndex] = child;
+                copyNodeRecurse(srcChild, child);
+            }
+        }
+    }
+
+    void Octree::releaseCompactPoints()
+    {
+        compact = false;
+        compactPoints.clear();
+        compactIndices.clear();
+        compactPointData = nullptr;
+        compactIndexData = nullptr;
+        mappedFile.reset();
+    }
+
+    size_t Octree::leafPointCount(const OctreeNode* leaf) const
+    {
+        return compact ? (size_t)leaf->pointCount : leaf->pointList.size();
+    }
+
+    const Point3f* Octree::leafPoint(const OctreeNode* leaf, size_t i) const
+    {
+        return compact ? &compactPointData[leaf->pointOffset + i] : leaf->pointList[i];
+    }
+
+    int Octree::findPointInLeaf(const OctreeNode* leaf, const Point3f& point) const
+    {
+        size_t pointNum = leafPointCount(leaf);
+        for(size_t i = 0; i < pointNum; i++)
+        {
+            const Point3f* p = leafPoint(leaf, i);
+            OCTREE_QUERY_STAT(leafPointsScanned, 1);
+            if((point.x == p->x) && (point.y == p->y) && (point.z == p->z))
+            {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    bool Octree::isCompact() const
+    {
+        return compact;
+    }
+
+    const Point3f* Octree::getLeafPoints(const OctreeNode* leaf) const
+    {
+        CV_Assert(compact && leaf->isLeaf);
+        return &compactPointData[leaf->pointOffset];
+    }
+
+    const Point3f* Octree::getCompactPoints() const
+    {
+        return compact ? compactPointData : nullptr;
+    }
+
+    const int* Octree::getLeafPointIndices(const OctreeNode* leaf) const
+    {
+        CV_Assert(compact && leaf->isLeaf);
+        return &compactIndexData[leaf->pointOffset];
+    }
+
+    void Octree::insertPoint(OctreeNode*& node, Point3f &point)
+    {
+        if(compact)
+        {
+            CV_Error(Error::StsNotImplemented, "Points can not be inserted in a compact Octree!");
+        }
+
+        if(autoExpand && node == rootNode && !isPointInBound(point))
+        {
+            expandRoot(point, point);
+            node = rootNode;
+        }
+
+        if(node == nullptr)
+        {
+            node = getNodePool().allocate( 0, size, origin, -1);
+        }
+
+        if(!isPointInBound(point, node->origin, node->size))
+        {
+            CV_Error(Error::StsBadArg, "The point is out of boundary!");
+        }
+
+        insertPointRecurse(node, point, mortonCode(point));
+    }
+
+    void Octree::insertPoints(std::vector<Point3f>& points)
+    {
+        insertPoints(points.data(), points.size());
+    }
+
+    void Octree::insertPoints(Point3f* points, size_t pointNum)
+    {
+        if(compact)
+        {
+            CV_Error(Error::StsNotImplemented, "Points can not be inserted in a compact Octree!");
+        }
+        if(pointNum == 0)
+        {
+            return;
+        }
+        CV_Assert(maxDepth >= 0 && maxDepth <= MORTON_MAX_DEPTH);
+
+        // The batch is in the root cube when both corners of its bounding box are.
+        Point3f low = points[0], high = points[0];
+        for(size_t i = 0; i < pointNum; i++)
+        {
+            const Point3f& p = points[i];
+            if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+            {
+                CV_Error(Error::StsBadArg, "The point is out of boundary!");
+            }
+            low = Point3f(std::min(low.x, p.x), std::min(low.y, p.y), std::min(low.z, p.z));
+            high = Point3f(std::max(high.x, p.x), std::max(high.y, p.y), std::max(high.z, p.z));
+        }
+        if(!isPointInBound(low) || !isPointInBound(high))
+        {
+            if(!autoExpand)
+            {
+                CV_Error(Error::StsBadArg, "The point is out of boundary!");
+            }
+            expandRoot(low, high);
+        }
+
+        std::vector<uint64> keys(pointNum);
+        std::vector<int> indices(pointNum);
+        computeMortonCodes(points, pointNum, origin, size, maxDepth, keys.data());
+        for(size_t idx = 0; idx < pointNum; idx++)
+        {
+            indices[idx] = (int)idx;
+        }
+        std::vector<uint64> keysTmp(pointNum);
+        std::vector<int> indicesTmp(pointNum);
+        radixSortMorton(keys.data(), indices.data(), pointNum, 3 * maxDepth, keysTmp.data(), indicesTmp.data());
+
+        if(rootNode == nullptr)
+        {
+            rootNode = getNodePool().allocate(0, size, origin, -1);
+        }
+
+        if(leafCapacity > 0)
+        {
+            // The leaves move down as they fill up, there is no path to reuse.
+            for(size_t i = 0; i < pointNum; i++)
+            {
+                insertPointInBucket(rootNode, points[indices[i]], keys[i]);
+            }
+            return;
+        }
+
+        // path[d] is the node at depth d on the path of the previous point.
+        std::vector<OctreeNode*> path(maxDepth + 1);
+        path[0] = rootNode;
+        for(size_t i = 0; i < pointNum; i++)
+        {
+            const uint64 key = keys[i];
+            int depth = 0;
+            if(i > 0)
+            {
+                const uint64 diff = key ^ keys[i - 1];
+                while(depth < maxDepth && (diff >> (3 * (maxDepth - depth - 1))) == 0)
+                {
+                    depth++;
+                }
+            }
+
+            OctreeNode* node = path[depth];
+            for(; depth < maxDepth; depth++)
+            {
+                int childIndex = (int)((key >> (3 * (maxDepth - depth - 1))) & 7);
+                if(node->children[childIndex] == nullptr)
+                {
+                    createChild(node, childIndex, *nodePool);
+                }
+                node = node->children[childIndex];
+                path[depth + 1] = node;
+            }
+            node->isLeaf = true;
+            node->pointList.push_back(&points[indices[i]]);
+            leafPointInserted(node);
+        }
+    }
+
+    void Octree::setAutoExpand(bool enable)
+    {
+        autoExpand = enable;
+    }
+
+    bool Octree::getAutoExpand() const
+    {
+        return autoExpand;
+    }
+
+    void Octree::setLeafCapacity(size_t capacity)
+    {
+        leafCapacity = capacity;
+    }
+
+    size_t Octree::getLeafCapacity() const
+    {
+        return leafCapacity;
+    }
+
+    void Octree::expandRoot(const Point3f& low, const Point3f& high)
+    {
+        if(!std::isfinite(low.x) || !std::isfinite(low.y) || !std::isfinite(low.z) ||
+           !std::isfinite(high.x) || !std::isfinite(high.y) || !std::isfinite(high.z))
+        {
+            CV_Error(Error::StsBadArg, "The point is out of boundary!");
+        }
+        if(size <= 0)
+        {
+            CV_Error(Error::StsBadArg, "The root cube of the Octree has no size!");
+        }
+
+        bool expanded = false;
+        while(!isPointInBound(low) || !isPointInBound(high))
+        {
+            if(maxDepth >= MORTON_MAX_DEPTH)
+            {
+                CV_Error(Error::StsOutOfRange, "The Octree can not be expanded beyond the maximum depth!");
+            }
+
+            // Grow towards the box on every axis where it sticks out, the old root takes the opposite corner.
+            Point3f newOrigin = origin;
+            int childIndex = 0;
+            if(low.x < origin.x) { newOrigin.x = (float)(origin.x - size); childIndex |= 1; }
+            if(low.y < origin.y) { newOrigin.y = (float)(origin.y - size); childIndex |= 2; }
+            if(low.z < origin.z) { newOrigin.z = (float)(origin.z - size); childIndex |= 4; }
+
+            if(rootNode != nullptr)
+            {
+                OctreeNode* newRoot = nodePool->allocate(0, 2 * size, newOrigin, -1);
+                newRoot->children[childIndex] = rootNode;
+                rootNode->parent = newRoot;
+                rootNode->parentIndex = childIndex;
+                rootNode = newRoot;
+            }
+            origin = newOrigin;
+            size *= 2;
+            maxDepth++;
+            expanded = true;
+        }
+        if(!expanded || rootNode == nullptr)
+        {
+            return;
+        }
+        releaseLeafAdjacency();
+
+        // Renumber the depths, and check the points against the codes of the new root: single precision
+        // quantization against another origin may put a point lying on a cell boundary in the neighbour cell.
+        std::vector<Point3f*> misplaced;
+        std::vector<std::pair<OctreeNode*, uint64> > stack(1, std::make_pair(rootNode, (uint64)0));
+        while(!stack.empty())
+        {
+            OctreeNode* node = stack.back().first;
+            uint64 key = stack.back().second;
+            stack.pop_back();
+            node->depth = node->parent == nullptr ? 0 : node->parent->depth + 1;
+
+            if(!node->isLeaf)
+            {
+                for(int childIndex = childNum - 1; childIndex >= 0; childIndex--)
+                {
+                    if(node->children[childIndex] != nullptr)
+                        stack.push_back(std::make_pair(node->children[childIndex], (key << 3) | (uint64)childIndex));
+                }
+                continue;
+            }
+
+            size_t kept = 0;
+            const int leafShift = 3 * (maxDepth - node->depth);
+            for(size_t i = 0; i < node->pointList.size(); i++)
+            {
+                Point3f* point = node->pointList[i];
+                if((mortonCode(*point) >> leafShift) == key)
+                    node->pointList[kept++] = point;
+                else
+                    misplaced.push_back(point);
+            }
+            if(kept != node->pointList.size())
+            {
+                node->pointList.resize(kept);
+                if(node->aggregate)
+                {
+                    node->aggregate->valid = false;
+                }
+                invalidateCaches(node);
+            }
+
+            // Drop the emptied leaf, and its ancestors left without children.
+            while(kept == 0 && node->parent != nullptr)
+            {
+                OctreeNode* parent = node->parent;
+                parent->children[node->parentIndex] = nullptr;
+                nodePool->release(node);
+                node = parent;
+                for(int childIndex = 0; childIndex < childNum; childIndex++)
+                {
+                    if(node->children[childIndex] != nullptr)
+                        kept = 1;
+                }
+            }
+        }
+
+        for(Point3f* point : misplaced)
+        {
+            insertPointRecurse(rootNode, *point, mortonCode(*point));
+        }
+    }
+
+    OctreeNode* Octree::createChild(OctreeNode* node, int childIndex, OctreeNodePool& pool) const
+    {
+        size_t xIndex = childIndex & 1;
+        size_t yIndex = (childIndex >> 1) & 1;
+        size_t zIndex = (childIndex >> 2) & 1;
+        double childSize = node->size / 2.0;
+        Point3f childOrigin = node->origin + Point3f(xIndex * childSize,yIndex * childSize, zIndex * childSize);
+
+        OctreeNode* child = pool.allocate(node->depth + 1, childSize, childOrigin, childIndex);
+        child->parent = node;
+        node->children[childIndex] = child;
+        return child;
+    }
+
+    bool Octree::convertFromPointCloud(std::vector<Point3f> &pointCloud, int flags)
+    {
+        Point3f minBound, maxBound;
+        if(!findBoundingBox(pointCloud.data(), pointCloud.size(), minBound, maxBound))
+        {
+            return false;
+        }
+        setRootCube(minBound, maxBound);
+
+        buildTree(pointCloud.data(), pointCloud.size(), flags);
+        return true;
+    }
+
+    bool Octree::convertFromPointCloud(const Point3f* points, size_t pointNum, int flags)
+    {
+        Point3f minBound, maxBound;
+        if(!findBoundingBox(points, pointNum, minBound, maxBound))
+        {
+            return false;
+        }
+        setRootCube(minBound, maxBound);
+
+        // The compact build only reads the points.
+        buildTree(const_cast<Point3f*>(points), pointNum, flags | OCTREE_BUILD_COMPACT);
+        return true;
+    }
+
+    void Octree::setRootCube(const Point3f& minBound, const Point3f& maxBound)
+    {
+        fitRootCube(minBound, maxBound, boundPadding, origin, size);
+    }
+
+    void Octree::setBoundPadding(float padding)
+    {
+        CV_Assert(padding >= 0);
+        boundPadding = padding;
+    }
+
+    float Octree::getBoundPadding() const
+    {
+        return boundPadding;
+    }
+
+    void Octree::buildTree(Point3f* points, size_t pointNum, int flags)
+    {
+        releaseCompactPoints();
+        releaseLeafAdjacency();
+        compact = (flags & OCTREE_BUILD_COMPACT) != 0;
+
+        if(flags & OCTREE_BUILD_OPENCL)
+        {
+            buildFromMortonCodes(points, pointNum, true);
+            return;
+        }
+
+        if(flags & OCTREE_BUILD_PARALLEL)
+        {
+            buildFromMortonCodesParallel(points, pointNum);
+            return;
+        }
+
+        if(flags & (OCTREE_BUILD_MORTON | OCTREE_BUILD_COMPACT))
+        {
+            buildFromMortonCodes(points, pointNum);
+            return;
+        }
+
+        // Insert every point in PointCloud data.
+        for(size_t idx = 0; idx< pointNum; idx++ )
+        {
+            insertPoint(rootNode, points[idx]);
+        }
+    }
+
+    uint64 Octree::mortonCode(const Point3f& point) const
+    {
+        uint64 key;
+        computeMortonCodes(&point, 1, origin, size, maxDepth, &key);
+        return key;
+    }
+
+    void Octree::buildFromMortonCodes(Point3f* points, size_t pointNum, bool onDevice)
+    {
+        CV_Assert(maxDepth >= 0 && maxDepth <= MORTON_MAX_DEPTH);
+
+        getNodePool().reset();
+        rootNode = nullptr;
+        if(pointNum == 0)
+        {
+            return;
+        }
+
+        std::vector<uint64> keys(pointNum);
+        std::vector<int> indices(pointNum);
+        size_t outsideNum = 0;
+        if(onDevice && oclSortMortonCodes(points, pointNum, origin, size, maxDepth, keys.data(), indices.data(),
+                                          outsideNum))
+        {
+            if(outsideNum != 0)
+            {
+                CV_Error(Error::StsBadArg, "The point is out of boundary!");
+            }
+        }
+        else
+        {
+            if(computeMortonCodes(points, pointNum, origin, size, maxDepth, keys.data()) != 0)
+            {
+                CV_Error(Error::StsBadArg, "The point is out of boundary!");
+            }
+            for(size_t idx = 0; idx < pointNum; idx++)
+            {
+                indices[idx] = (int)idx;
+            }
+            std::vector<uint64> keysTmp(pointNum);
+            std::vector<int> indicesTmp(pointNum);
+            radixSortMorton(keys.data(), indices.data(), pointNum, 3 * maxDepth, keysTmp.data(), indicesTmp.data());
+        }
+
+        if(compact)
+        {
+            compactPoints.resize(pointNum);
+            for(size_t i = 0; i < pointNum; i++)
+            {
+                compactPoints[i] = points[indices[i]];
+            }
+            compactIndices = indices;
+            compactPointData = compactPoints.data();
+            compactIndexData = compactIndices.data();
+        }
+
+        rootNode = nodePool->allocate(0, size, origin, -1);
+        emitMortonSubtree(rootNode, keys.data(), indices.data(), pointNum, points, 0, *nodePool);
+    }
+
+    void Octree::buildFromMortonCodesParallel(Point3f* points, size_t _pointNum)
+    {
+        CV_Assert(maxDepth >= 0 && maxDepth <= MORTON_MAX_DEPTH);
+
+        getNodePool().reset();
+        rootNode = nullptr;
+        if(_pointNum == 0)
+        {
+            return;
+        }
+
+        const int pointNum = (int)_pointNum;
+        const int threadNum = std::max(cv::getNumThreads(), 1);
+
+        // Split at the first level with several subtrees per thread, the points of one subtree then form
+        // a contiguous run of the sorted keys.
+        int splitLevel = 0;
+        while(splitLevel < maxDepth && (1 << (3 * splitLevel)) < 8 * threadNum)
+        {
+            splitLevel++;
+        }
+        const int bucketNum = 1 << (3 * splitLevel);
+        const int bucketShift = 3 * (maxDepth - splitLevel);
+
+        std::vector<uint64> keys(pointNum);
+        std::vector<uint64> keysSorted(pointNum);
+        std::vector<int> indicesSorted(pointNum);
+        if(compact)
+        {
+            compactPoints.resize(pointNum);
+            compactIndices.resize(pointNum);
+            compactPointData = compactPoints.data();
+            compactIndexData = compactIndices.data();
+        }
+
+        // Morton codes and per-chunk bucket histograms.
+        const int chunkNum = std::min(threadNum * 4, pointNum);
+        std::vector<int> bucketCount((size_t)chunkNum * bucketNum, 0);
+        std::atomic<bool> outOfBound(false);
+        parallel_for_(Range(0, chunkNum), [&](const Range& range)
+        {
+            for(int chunk = range.start; chunk < range.end; chunk++)
+            {
+                int* count = &bucketCount[(size_t)chunk * bucketNum];
+                int begin = (int)((int64)pointNum * chunk / chunkNum);
+                int end = (int)((int64)pointNum * (chunk + 1) / chunkNum);
+                if(computeMortonCodes(points + begin, end - begin, origin, size, maxDepth, &keys[begin]) != 0)
+                {
+                    outOfBound = true;
+                }
+                for(int idx = begin; idx < end; idx++)
+                {
+                    count[keys[idx] >> bucketShift]++;
+                }
+            }
+        });
+        if(outOfBound)
+        {
+            CV_Error(Error::StsBadArg, "The point is out of boundary!");
+        }
+
+        // Stable counting sort by bucket: every chunk scatters from its own offset inside each bucket.
+        std::vector<int> bucketStart(bucketNum + 1);
+        int offset = 0;
+        for(int bucket = 0; bucket < bucketNum; bucket++)
+        {
+            bucketStart[bucket] = offset;
+            for(int chunk = 0; chunk < chunkNum; chunk++)
+            {
+                int& count = bucketCount[(size_t)chunk * bucketNum + bucket];
+                int c = count;
+                count = offset;
+                offset += c;
+            }
+        }
+        bucketStart[bucketNum] = offset;
+
+        parallel_for_(Range(0, chunkNum), [&](const Range& range)
+        {
+            for(int chunk = range.start; chunk < range.end; chunk++)
+            {
+                int* next = &bucketCount[(size_t)chunk * bucketNum];
+                int end = (int)((int64)pointNum * (chunk + 1) / chunkNum);
+                for(int idx = (int)((int64)pointNum * chunk / chunkNum); idx < end; idx++)
+                {
+                    int dst = next[keys[idx] >> bucketShift]++;
+                    keysSorted[dst] = keys[idx];
+                    indicesSorted[dst] = idx;
+                }
+            }
+        });
+
+        // Create the top levels serially, down to one node per occupied bucket. In leaf capacity mode, the levels
+        // depend on the point counts: the buckets are only sorted in parallel and the tree is emitted afterwards.
+        rootNode = nodePool->allocate(0, size, origin, -1);
+        std::vector<OctreeNode*> bucketNode(bucketNum, nullptr);
+        for(int bucket = 0; bucket < bucketNum && leafCapacity == 0; bucket++)
+        {
+            if(bucketStart[bucket] == bucketStart[bucket + 1])
+            {
+                continue;
+            }
+
+            OctreeNode* node = rootNode;
+            for(int level = 1; level <= splitLevel; level++)
+            {
+                int childIndex = (bucket >> (3 * (splitLevel - level))) & 7;
+                if(node->children[childIndex] == nullptr)
+                {
+                    createChild(node, childIndex, *nodePool);
+                }
+                node = node->children[childIndex];
+            }
+            bucketNode[bucket] = node;
+        }
+
+        // Hand the buckets out in stripes of roughly equal point count, each stripe with its own pool.
+        const int stripeNum = std::min(threadNum * 4, bucketNum);
+        std::vector<int> stripeStart(stripeNum + 1, bucketNum);
+        for(int bucket = 0, stripe = 0; bucket < bucketNum && stripe < stripeNum; bucket++)
+        {
+            if(bucketStart[bucket] >= (int)((int64)pointNum * stripe / stripeNum))
+            {
+                stripeStart[stripe++] = bucket;
+            }
+        }
+        stripeStart[0] = 0;
+
+        std::vector<std::unique_ptr<OctreeNodePool> > stripePools(stripeNum);
+        parallel_for_(Range(0, stripeNum), [&](const Range& range)
+        {
+            for(int stripe = range.start; stripe < range.end; stripe++)
+            {
+                stripePools[stripe].reset(new OctreeNodePool(nodePool.get()));
+                int first = bucketStart[stripeStart[stripe]];
+                int last = bucketStart[stripeStart[stripe + 1]];
+                std::vector<uint64> keysTmp(last - first);
+                std::vector<int> indicesTmp(last - first);
+
+                for(int bucket = stripeStart[stripe]; bucket < stripeStart[stripe + 1]; bucket++)
+                {
+                    int start = bucketStart[bucket];
+                    int num = bucketStart[bucket + 1] - start;
+                    if(num == 0)
+                    {
+                        continue;
+                    }
+                    radixSortMorton(&keysSorted[start], &indicesSorted[start], num, bucketShift,
+                                    &keysTmp[start - first], &indicesTmp[start - first]);
+                    if(compact)
+                    {
+                        for(int i = start; i < start + num; i++)
+                        {
+                            compactPoints[i] = points[indicesSorted[i]];
+                            compactIndices[i] = indicesSorted[i];
+                        }
+                    }
+                    if(bucketNode[bucket] != nullptr)
+                    {
+                        emitMortonSubtree(bucketNode[bucket], &keysSorted[start], &indicesSorted[start], num,
+                                          points, start, *stripePools[stripe]);
+                    }
+                }
+            }
+        });
+
+        if(leafCapacity > 0)
+        {
+            emitBucketSubtree(rootNode, keysSorted.data(), indicesSorted.data(), pointNum, points, 0, *nodePool);
+        }
+
+        for(int stripe = 0; stripe < stripeNum; stripe++)
+        {
+            nodePool->merge(*stripePools[stripe]);
+        }
+    }
+
+    void Octree::emitMortonSubtree(OctreeNode* subRoot, const uint64* keys, const int* indices, size_t pointNum,
+                                   Point3f* points, int firstPosition, OctreeNodePool& pool) const
+    {
+        if(leafCapacity > 0)
+        {
+            emitBucketSubtree(subRoot, keys, indices, pointNum, points, firstPosition, pool);
+            return;
+        }
+
+        // Points sharing a key prefix share the path down to the level where the keys diverge, so walking the
+        // sorted keys with the current path on a stack creates every node exactly once, in depth-first order.
+        const int topLevel = subRoot->depth;
+        std::vector<OctreeNode*> path(maxDepth + 1);
+        path[topLevel] = subRoot;
+        for(size_t i = 0; i < pointNum; i++)
+        {
+            int level = topLevel + 1;
+            if(i > 0)
+            {
+                uint64 diff = keys[i] ^ keys[i - 1];
+                if(diff == 0)
+                {
+                    level = maxDepth + 1;
+                }
+                else
+                {
+                    int highestBit = 63;
+                    while(!((diff >> highestBit) & 1))
+                    {
+                        highestBit--;
+                    }
+                    level = maxDepth - highestBit / 3;
+                }
+            }
+
+            for(; level <= maxDepth; level++)
+            {
+                int childIndex = (int)((keys[i] >> (3 * (maxDepth - level))) & 7);
+                path[level] = createChild(path[level - 1], childIndex, pool);
+            }
+
+            OctreeNode* leaf = path[maxDepth];
+            leaf->isLeaf = true;
+            if(compact)
+            {
+                if(leaf->pointCount == 0)
+                {
+                    leaf->pointOffset = firstPosition + (int)i;
+                }
+                leaf->pointCount++;
+            }
+            else
+            {
+                leaf->pointList.push_back(&points[indices[i]]);
+            }
+        }
+    }
+
+    void Octree::emitBucketSubtree(OctreeNode* subRoot, const uint64* keys, const int* indices, size_t pointNum,
+                                   Point3f* points, int firstPosition, OctreeNodePool& pool) const
+    {
+        if(pointNum <= leafCapacity || subRoot->depth >= maxDepth)
+        {
+            subRoot->isLeaf = true;
+            if(compact)
+            {
+                subRoot->pointOffset = firstPosition;
+                subRoot->pointCount = (int)pointNum;
+            }
+            else
+            {
+                subRoot->pointList.resize(pointNum);
+                for(size_t i = 0; i < pointNum; i++)
+                {
+                    subRoot->pointList[i] = &points[indices[i]];
+                }
+            }
+            return;
+        }
+
+        // The keys are sorted, so the points of each child form a contiguous run.
+        const int shift = 3 * (maxDepth - subRoot->depth - 1);
+        size_t begin = 0;
+        while(begin < pointNum)
+        {
+            int childIndex = (int)((keys[begin] >> shift) & 7);
+            size_t end = std::partition_point(keys + begin, keys + pointNum, [shift, childIndex](uint64 key)
+            {
+                return (int)((key >> shift) & 7) == childIndex;
+            }) - keys;
+            OctreeNode* child = createChild(subRoot, childIndex, pool);
+            emitBucketSubtree(child, keys + begin, indices + begin, end - begin, points, firstPosition + (int)begin,
+                              pool);
+            begin = end;
+        }
+    }
+
+
+    Point3f Octree::findCenterInPointCloud(std::vector<Point3f> &pointCloud)
+    {
+        return findCenterInPointCloud(pointCloud.data(), pointCloud.size());
+    }
+
+    Point3f Octree::findCenterInPointCloud(const Point3f* points, size_t pointNum)
+    {
+        Point3f minBound, maxBound;
+        if(!findBoundingBox(points, pointNum, minBound, maxBound))
+        {
+            return Point3f(0, 0, 0);
+        }
+        return (maxBound+minBound)/2.0;
+    }
+
+    bool Octree::findBoundingBox(const Point3f* points, size_t pointNum, Point3f& minBound, Point3f& maxBound)
+    {
+        if(pointNum == 0)
+        {
+            return false;
+        }
+
+        // Blocks of a few thousand points, so that small clouds stay on one thread.
+        const int chunkNum = (int)std::min<size_t>((size_t)std::max(cv::getNumThreads(), 1) * 4,
+                                                   (pointNum + 4095) / 4096);
+        std::vector<Point3f> chunkMin(chunkNum, points[0]), chunkMax(chunkNum, points[0]);
+        parallel_for_(Range(0, chunkNum), [&](const Range& range)
+        {
+            for(int chunk = range.start; chunk < range.end; chunk++)
+            {
+                size_t begin = pointNum * chunk / chunkNum;
+                size_t end = pointNum * (chunk + 1) / chunkNum;
+                boundingBoxOfBlock(points + begin, end - begin, chunkMin[chunk], chunkMax[chunk]);
+            }
+        });
+
+        minBound = chunkMin[0];
+        maxBound = chunkMax[0];
+        for(int chunk = 1; chunk < chunkNum; chunk++)
+        {
+            minBound = Point3f(std::min(minBound.x, chunkMin[chunk].x), std::min(minBound.y, chunkMin[chunk].y),
+                               std::min(minBound.z, chunkMin[chunk].z));
+            maxBound = Point3f(std::max(maxBound.x, chunkMax[chunk].x), std::max(maxBound.y, chunkMax[chunk].y),
+                               std::max(maxBound.z, chunkMax[chunk].z));
+        }
+        return true;
+    }
+
+    bool Octree::isPointInBound(const Point3f& _point, OctreeNode*& _node)
+    {
+        if((_point.x >= _node->origin.x && _point.y >= _node->origin.y && _point.z >= _node->origin.z)
+            && (_point.x <= _node->origin.x + _node->size && _point.y <= _node->origin.y + _node->size && _point.z <= _node->origin.z + _node->size))
+        {
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    bool Octree::isPointInBound(const Point3f &_point) const
+    {
+        if((_point.x >= origin.x && _point.y >= origin.y && _point.z >= origin.z) && (_point.x <= origin.x + size && _point.y <= origin.y + size && _point.z <= origin.z + size))
+        {
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    bool Octree::isPointInBound(const Point3f &_point, Point3f &_origin, double _size)
+    {
+        if((_point.x >= _origin.x && _point.y >= _origin.y && _point.z >= _origin.z) && (_point.x <= _origin.x + _size && _point.y <= _origin.y + _size && _point.z <= _origin.z + _size))
+        {
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    void Octree::clear()
+    {
+        // All nodes live in the pool, so the tree is released without visiting it.
+        if(nodePool)
+        {
+            nodePool->reset();
+        }
+        rootNode = nullptr;
+        releaseCompactPoints();
+        releaseLeafAdjacency();
+
+        size = 0;
+        maxDepth = 0;
+        origin = Point3f (0,0,0); // origin coordinate
+    }
+
+    bool Octree::isEmpty() const
+    {
+     return rootNode == nullptr;
+    }
+
+    OctreeStats Octree::getStats() const
+    {
+        OctreeStats stats;
+        stats.poolBytes = nodePool ? nodePool->capacityBytes() : 0;
+        stats.compactBytes = compactPoints.capacity() * sizeof(Point3f) + compactIndices.capacity() * sizeof(int);
+        if(rootNode != nullptr)
+        {
+            stats.nodesPerDepth.assign((size_t)maxDepth + 1, 0);
+            traverseDFS(rootNode, [&](OctreeNode* node)
+            {
+                if((size_t)node->depth >= stats.nodesPerDepth.size())
+                {
+                    stats.nodesPerDepth.resize((size_t)node->depth + 1, 0);
+                }
+                stats.nodesPerDepth[node->depth]++;
+                stats.nodeCount++;
+                stats.pointListBytes += node->pointList.capacity() * sizeof(Point3f*);
+                if(!node->isLeaf)
+                {
+                    return OCTREE_TRAVERSAL_CONTINUE;
+                }
+
+                size_t pointNum = leafPointCount(node);
+                size_t bin = 0;
+                while((pointNum >> (bin + 1)) != 0)
+                {
+                    bin++;
+                }
+                if(bin >= stats.leafOccupancy.size())
+                {
+                    stats.leafOccupancy.resize(bin + 1, 0);
+                }
+                stats.leafOccupancy[bin]++;
+                stats.leafCount++;
+                stats.pointCount += pointNum;
+                stats.maxPointsPerLeaf = std::max(stats.maxPointsPerLeaf, pointNum);
+                return OCTREE_TRAVERSAL_SKIP_CHILDREN;
+            });
+            stats.meanPointsPerLeaf = stats.leafCount == 0 ? 0 : (double)stats.pointCount / stats.leafCount;
+        }
+
+        // Nodes created outside the pool, if any, are only counted by nodeBytes.
+        stats.nodeBytes = stats.nodeCount * sizeof(OctreeNode);
+        stats.totalBytes = std::max(stats.poolBytes, stats.nodeBytes) + stats.pointListBytes + stats.compactBytes;
+        return stats;
+    }
+
+    OctreeQueryStats Octree::getQueryStats()
+    {
+#ifdef OCTREE_ENABLE_QUERY_STATS
+        return threadQueryStats();
+#else
+        return OctreeQueryStats();
+#endif
+    }
+
+    void Octree::resetQueryStats()
+    {
+#ifdef OCTREE_ENABLE_QUERY_STATS
+        threadQueryStats() = OctreeQueryStats();
+#endif
+    }
+
+    void Octree::traverseRecurseBFS( OctreeNode*&node, const std::function<bool ( OctreeNode*&)>&f )
+    {
+
+        if(node == nullptr)
+        {
+            return;
+        }
+        else
+        {
+            for(size_t childIndex = 0; childIndex < Octree::childNum; ++childIndex)
+            {
+                traverseRecurseBFS(node->children[childIndex], f);
+            }
+
+            if(!f(node)) return;
+        }
+    }
+
+    void Octree::traverseRecurseDFS( OctreeNode* &node, const std::function<bool ( OctreeNode*&)>&f )
+    {
+
+        if(node == nullptr)
+        {
+            return;
+        }
+        else
+        {
+            if(!f(node)) return;
+
+            for(size_t childIndex = 0; childIndex < childNum; ++childIndex)
+            {
+                traverseRecurseDFS(node->children[childIndex], f);
+            }
+        }
+    }
+
+    OctreeNode* Octree::index(const Point3f& point) const
+    {
+        OCTREE_QUERY_STAT(boundTests, 1);
+        if(isPointInBound(point))
+        {
+            OctreeNode* root = rootNode;
+            return this->index(point, root);
+        }
+        else
+        {
+            return nullptr;
+        }
+    }
+
+    OctreeNode* Octree::index(const Point3f& point, OctreeNode*& node) const
+    {
+
+        OCTREE_QUERY_STAT(queries, 1);
+        if(node == nullptr)
+        {
+         return nullptr;
+        }
+
+        OCTREE_QUERY_STAT(nodesVisited, 1);
+        if(node->isLeaf)
+        {
+            return findPointInLeaf(node, point) >= 0 ? node : nullptr;
+        }
+
+        OCTREE_QUERY_STAT(boundTests, 1);
+        if(!this->isPointInBound(point, node->origin, node->size))
+        {
+            return nullptr;
+        }
+
+        // The child at every level is given by the Morton code, the same way the points were inserted.
+        uint64 key = mortonCode(point);
+        OctreeNode* current = node;
+        while(!current->isLeaf)
+        {
+            int childIndex = (int)((key >> (3 * (maxDepth - current->depth - 1))) & 7);
+            current = current->children[childIndex];
+            if(current == nullptr)
+            {
+                return nullptr;
+            }
+            OCTREE_QUERY_STAT(nodesVisited, 1);
+        }
+        return findPointInLeaf(current, point) >= 0 ? current : nullptr;
+    }
+
+    bool Octree::deletePoint(Point3f& point)
+    {
+        OctreeNode* node = index(point, rootNode);
+        if(node == nullptr)
+        {
+            return false;
+        }
+
+        int position = findPointInLeaf(node, point);
+        if(position < 0)
+        {
+            return false;
+        }
+        removeLeafPoint(node, position);
+        pruneEmptyNode(node);
+        return true;
+    }
+
+    size_t Octree::deletePoints(const std::vector<Point3f>& points)
+    {
+        if(rootNode == nullptr || points.empty())
+        {
+            return 0;
+        }
+
+        std::vector<OctreeNode*> nodes;
+        index(points, nodes);
+
+        // Group the points by leaf, so that each leaf is visited once.
+        std::vector<std::pair<OctreeNode*, int> > targets;
+        targets.reserve(points.size());
+        for(size_t i = 0; i < points.size(); i++)
+        {
+            if(nodes[i] != nullptr)
+                targets.push_back(std::make_pair(nodes[i], (int)i));
+        }
+        std::sort(targets.begin(), targets.end());
+
+        size_t deleted = 0;
+        std::vector<OctreeNode*> emptied;
+        std::vector<const Point3f*> pending;
+        for(size_t first = 0; first < targets.size(); )
+        {
+            OctreeNode* leaf = targets[first].first;
+            size_t last = first;
+            pending.clear();
+            for(; last < targets.size() && targets[last].first == leaf; last++)
+            {
+                pending.push_back(&points[targets[last].second]);
+            }
+            first = last;
+
+            // One pass over the leaf, each pending point removes one matching point.
+            for(size_t i = 0; i < leafPointCount(leaf) && !pending.empty(); )
+            {
+                const Point3f* p = leafPoint(leaf, i);
+                auto match = std::find_if(pending.begin(), pending.end(), [p](const Point3f* q)
                 {
-                    children[i]->clear();
+                    return (q->x == p->x) && (q->y == p->y) && (q->z == p->z);
+                });
+                if(match == pending.end())
+                {
+                    i++;
+                    continue;
                 }
+                *match = pending.back();
+                pending.pop_back();
+                removeLeafPoint(leaf, i);
+                deleted++;
             }
-            if(parentIndex != -1)
+            if(leafPointCount(leaf) == 0)
             {
-                parent->children[parentIndex] = nullptr;
+                emptied.push_back(leaf);
             }
-            delete this;
         }
+
+        for(OctreeNode* leaf : emptied)
+        {
+            pruneEmptyNode(leaf);
+        }
+        return deleted;
     }
 
-    Octree::Octree(int _maxDepth, double _size, Point3f _origin ):maxDepth(_maxDepth),size(_size),origin(_origin)
+    void Octree::removeLeafPoint(OctreeNode* leaf, size_t i)
     {
+        if(compact && mappedFile)
+        {
+            CV_Error(Error::StsError, "A memory mapped Octree is read-only!");
+        }
+        if(leaf->aggregate && leaf->aggregate->valid)
+        {
+            leaf->aggregate->accumulate(*leafPoint(leaf, i), leafPointAttributes(leaf, i), -1);
+        }
+        releaseLeafAdjacency();
+
+        if(compact)
+        {
+            // Keep the points of the leaf contiguous by moving the last one into the hole.
+            int last = leaf->pointOffset + leaf->pointCount - 1;
+            int pos = leaf->pointOffset + (int)i;
+            std::swap(compactPoints[pos], compactPoints[last]);
+            std::swap(compactIndices[pos], compactIndices[last]);
+            leaf->pointCount--;
+        }
+        else
+        {
+            leaf->pointList[i] = leaf->pointList.back();
+            leaf->pointList.pop_back();
+        }
+        invalidateCaches(leaf);
     }
 
-    Octree::Octree(int _maxDepth, std::vector<Point3f>& _pointCloud):maxDepth(_maxDepth),size(0)
+    void Octree::invalidateCaches(OctreeNode* node)
     {
-        convertFromPointCloud(_pointCloud);
+        node->hash = 0;
+        for(node = node->parent; node != nullptr; node = node->parent)
+        {
+            node->hash = 0;
+            if(node->aggregate)
+            {
+                node->aggregate->valid = false;
+            }
+        }
     }
 
-    Octree::Octree(int _maxDepth):maxDepth(_maxDepth), size(0), origin(0,0,0)
+    void Octree::leafPointInserted(OctreeNode* leaf)
     {
+        releaseLeafAdjacency();
+        if(leaf->aggregate && leaf->aggregate->valid)
+        {
+            size_t last = leafPointCount(leaf) - 1;
+            leaf->aggregate->accumulate(*leafPoint(leaf, last), leafPointAttributes(leaf, last), 1);
+        }
+        invalidateCaches(leaf);
     }
 
-    void Octree::insertPoint(OctreeNode*& node, Point3f &point)
+    void Octree::pruneEmptyNode(OctreeNode* node)
     {
-        if(node == nullptr)
+        for(;;)
         {
-            node = new OctreeNode( 0, size, origin, -1);
-        }
+            bool empty = node->isLeaf ? leafPointCount(node) == 0 :
+                         std::all_of(node->children.begin(), node->children.end(),
+                                     [](const OctreeNode* child) { return child == nullptr; });
+            if(!empty)
+            {
+                return;
+            }
 
-        insertPointRecurse(node, point);
+            OctreeNode* parent = node->parent;
+            if(parent == nullptr)
+            {
+                // The root node, the tree is empty.
+                rootNode->clear();
+                rootNode = nullptr;
+                return;
+            }
+            node->clear();
+            node = parent;
+        }
     }
 
-    bool Octree::convertFromPointCloud(std::vector<Point3f> &pointCloud)
+    void Octree::insertPointRecurse( OctreeNode*& node,  Point3f& point, uint64 key)
     {
-        // Find center coordinate of PointCloud data.
-        Point3f center = cv::Octree::findCenterInPointCloud(pointCloud);
+        if(leafCapacity > 0)
+        {
+            insertPointInBucket(node, point, key);
+            return;
+        }
 
-        float halfSize = std::max(center.x, std::max(center.y, center.z));
-        this->origin = center - Point3f(halfSize, halfSize, halfSize);
-        this->size = 2 * halfSize;
+        if(node->depth == maxDepth)
+        {
+            node->isLeaf = true;
+            node->pointList.push_back(&point);
+            leafPointInserted(node);
+            return;
+        }
 
-        // Insert every point in PointCloud data.
-        for(size_t idx = 0; idx< pointCloud.size(); idx++ )
+        int childIndex = (int)((key >> (3 * (maxDepth - node->depth - 1))) & 7);
+        if(node->children[childIndex] == nullptr)
         {
-            insertPoint(rootNode, pointCloud[idx]);
+            createChild(node, childIndex, *nodePool);
         }
-        return true;
-    }
+        insertPointRecurse(node->children[childIndex], point, key);
 
+    }
 
-    Point3f Octree::findCenterInPointCloud(std::vector<Point3f> &pointCloud)
+    void Octree::insertPointInBucket(OctreeNode* node, Point3f& point, uint64 key)
     {
-        Point3f maxBound(pointCloud[0]);
-        Point3f minBound(pointCloud[0]);
-
-        for(size_t idx = 0; idx <pointCloud.size(); idx++)
+        while(!node->isLeaf)
         {
-            maxBound.x = max(pointCloud[idx].x, maxBound.x);
-            maxBound.y = max(pointCloud[idx].y, maxBound.y);
-            maxBound.z = max(pointCloud[idx].z, maxBound.z);
+            // Only the root node of an empty tree is neither a leaf nor has children.
+            if(std::all_of(node->children.begin(), node->children.end(),
+                           [](const OctreeNode* child) { return child == nullptr; }))
+            {
+                node->isLeaf = true;
+                break;
+            }
 
-            minBound.x = min(pointCloud[idx].x, minBound.x);
-            minBound.y = min(pointCloud[idx].y, minBound.y);
-            minBound.z = min(pointCloud[idx].z, minBound.z);
+            int childIndex = (int)((key >> (3 * (maxDepth - node->depth - 1))) & 7);
+            if(node->children[childIndex] == nullptr)
+            {
+                node = createChild(node, childIndex, *nodePool);
+                node->isLeaf = true;
+                break;
+            }
+            node = node->children[childIndex];
         }
-        return (maxBound+minBound)/2.0;
+        node->pointList.push_back(&point);
+        leafPointInserted(node);
+        splitLeaf(node);
     }
 
-    bool Octree::isPointInBound(const Point3f& _point, OctreeNode*& _node)
+    void Octree::splitLeaf(OctreeNode* leaf)
     {
-        if((_point.x > _node->origin.x && _point.y > _node->origin.y && _point.z > _node->origin.z)
-            && (_point.x < _node->origin.x + _node->size && _point.y < _node->origin.y + _node->size && _point.z < _node->origin.z + _node->size))
+        if(leaf->pointList.size() <= leafCapacity || leaf->depth >= maxDepth)
         {
-            return true;
+            return;
         }
-        else
+
+        std::vector<Point3f*> points;
+        points.swap(leaf->pointList);
+        leaf->isLeaf = false;
+        const int shift = 3 * (maxDepth - leaf->depth - 1);
+        for(Point3f* point : points)
         {
-            return false;
+            int childIndex = (int)((mortonCode(*point) >> shift) & 7);
+            OctreeNode* child = leaf->children[childIndex];
+            if(child == nullptr)
+            {
+                child = createChild(leaf, childIndex, *nodePool);
+                child->isLeaf = true;
+            }
+            child->pointList.push_back(point);
+        }
+
+        // The points may all fall in the same child, which then overflows in turn.
+        for(OctreeNode* child : leaf->children)
+        {
+            if(child != nullptr)
+            {
+                splitLeaf(child);
+            }
         }
     }
 
-    bool Octree::isPointInBound(const Point3f &_point) const
+    int Octree::radiusNNSearch(const Point3f& query, float radius, std::vector<Point3f>& pointSet,
+                               std::vector<float>& squareDistSet) const
     {
-        if((_point.x > origin.x && _point.y > origin.y && _point.z > origin.z) && (_point.x < origin.x + size && _point.y < origin.y + size && _point.z < origin.z + size))
+        pointSet.clear();
+        squareDistSet.clear();
+        if(rootNode == nullptr || radius < 0)
         {
-            return true;
+            return 0;
         }
-        else
+
+        OCTREE_QUERY_STAT(queries, 1);
+        std::vector<std::pair<float, const Point3f*> > candidates;
+        radiusNNSearchRecurse(rootNode, query, radius * radius, candidates);
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const std::pair<float, const Point3f*>& a, const std::pair<float, const Point3f*>& b)
+                  {
+                      return a.first < b.first;
+                  });
+
+        pointSet.resize(candidates.size());
+        squareDistSet.resize(candidates.size());
+        for(size_t i = 0; i < candidates.size(); i++)
         {
-            return false;
+            squareDistSet[i] = candidates[i].first;
+            pointSet[i] = *candidates[i].second;
         }
+        return (int)candidates.size();
     }
 
-    bool Octree::isPointInBound(const Point3f &_point, Point3f &_origin, double _size)
+    void Octree::radiusNNSearchRecurse(const OctreeNode* node, const Point3f& query, float squareRadius,
+                                       std::vector<std::pair<float, const Point3f*> >& candidates) const
     {
-        if((_point.x > _origin.x && _point.y > _origin.y && _point.z > _origin.z) && (_point.x < _origin.x + _size && _point.y < _origin.y + _size && _point.z < _origin.z + _size))
+        OCTREE_QUERY_STAT(nodesVisited, 1);
+        if(node->isLeaf)
         {
-            return true;
+            size_t pointNum = leafPointCount(node);
+            OCTREE_QUERY_STAT(leafPointsScanned, pointNum);
+            for(size_t i = 0; i < pointNum; i++)
+            {
+                const Point3f* point = leafPoint(node, i);
+                float dist = squareDist(query, *point);
+                if(dist <= squareRadius)
+                {
+                    candidates.emplace_back(dist, point);
+                }
+            }
+            return;
         }
-        else
+
+        float childDists[childNum];
+        squareDistToChildren(query, node, childDists);
+        OCTREE_QUERY_STAT(boundTests, childNum);
+        for(size_t childIndex = 0; childIndex < childNum; childIndex++)
         {
-            return false;
+            const OctreeNode* child = node->children[childIndex];
+            if(child != nullptr && childDists[childIndex] <= squareRadius)
+            {
+                radiusNNSearchRecurse(child, query, squareRadius, candidates);
+            }
         }
     }
 
-    void Octree::clear()
+    void Octree::KNNSearch(const Point3f& query, const int K, std::vector<Point3f>& pointSet,
+                           std::vector<float>& squareDistSet) const
     {
-        if(rootNode != nullptr)
+        pointSet.clear();
+        squareDistSet.clear();
+        if(rootNode == nullptr || K <= 0)
         {
-            rootNode->clear();
+            return;
         }
 
-        size = 0;
-        maxDepth = 0;
-        origin = Point3f (0,0,0); // origin coordinate
+        std::vector<std::pair<float, const OctreeNode*> > nodeHeap;
+        std::vector<std::pair<float, const Point3f*> > best;
+        pointSet.resize(K);
+        squareDistSet.resize(K);
+        int found = KNNSearchImpl(query, K, nodeHeap, best, pointSet.data(), squareDistSet.data());
+        pointSet.resize(found);
+        squareDistSet.resize(found);
     }
 
-    bool Octree::isEmpty() const
+    void Octree::KNNSearch(const std::vector<Point3f>& queries, const int K, std::vector<Point3f>& pointSet,
+                           std::vector<float>& squareDistSet) const
     {
-     return rootNode == nullptr;
+        if(K <= 0)
+        {
+            pointSet.clear();
+            squareDistSet.clear();
+            return;
+        }
+        pointSet.resize(queries.size() * K);
+        squareDistSet.resize(queries.size() * K);
+        if(queries.empty())
+        {
+            return;
+        }
+
+        std::vector<int> order;
+        sortByMortonCode(queries, order);
+
+        const int queryNum = (int)queries.size();
+        const int chunkNum = std::min(std::max(cv::getNumThreads(), 1) * 4, queryNum);
+        OCTREE_PARALLEL_QUERY_STATS(queryStats);
+        parallel_for_(Range(0, chunkNum), [&](const Range& range)
+        {
+            OCTREE_WORKER_QUERY_STATS(queryStats);
+            std::vector<std::pair<float, const OctreeNode*> > nodeHeap;
+            std::vector<std::pair<float, const Point3f*> > best;
+            int first = (int)((int64)queryNum * range.start / chunkNum);
+            int last = (int)((int64)queryNum * range.end / chunkNum);
+            for(int i = first; i < last; i++)
+            {
+                size_t offset = (size_t)order[i] * K;
+                int found = rootNode == nullptr ? 0 :
+                        KNNSearchImpl(queries[order[i]], K, nodeHeap, best, &pointSet[offset], &squareDistSet[offset]);
+                for(int k = found; k < K; k++)
+                {
+                    pointSet[offset + k] = Point3f(0, 0, 0);
+                    squareDistSet[offset + k] = std::numeric_limits<float>::infinity();
+                }
+            }
+        });
     }
 
-    void Octree::traverseRecurseBFS( OctreeNode*&node, const std::function<bool ( OctreeNode*&)>&f )
+    bool Octree::approximateNNSearch(const Point3f& query, Point3f& point, float& squareDist, float epsilon,
+                                     int maxLeafVisits) const
     {
+        CV_Assert(epsilon >= 0 && maxLeafVisits >= 0);
+        squareDist = std::numeric_limits<float>::infinity();
+        if(rootNode == nullptr)
+        {
+            return false;
+        }
 
-        if(node == nullptr)
+        std::vector<std::pair<float, const OctreeNode*> > nodeHeap;
+        return approximateNNSearchImpl(query, (1 + epsilon) * (1 + epsilon), maxLeafVisits, nodeHeap, point,
+                                       squareDist);
+    }
+
+    void Octree::approximateNNSearch(const std::vector<Point3f>& queries, std::vector<Point3f>& points,
+                                     std::vector<float>& squareDists, float epsilon, int maxLeafVisits) const
+    {
+        CV_Assert(epsilon >= 0 && maxLeafVisits >= 0);
+        points.resize(queries.size());
+        squareDists.resize(queries.size());
+        if(queries.empty())
         {
             return;
         }
-        else
+
+        std::vector<int> order;
+        sortByMortonCode(queries, order);
+
+        const float squareBound = (1 + epsilon) * (1 + epsilon);
+        const int queryNum = (int)queries.size();
+        const int chunkNum = std::min(std::max(cv::getNumThreads(), 1) * 4, queryNum);
+        OCTREE_PARALLEL_QUERY_STATS(queryStats);
+        parallel_for_(Range(0, chunkNum), [&](const Range& range)
         {
-            for(size_t childIndex = 0; childIndex < Octree::childNum; ++childIndex)
+            OCTREE_WORKER_QUERY_STATS(queryStats);
+            std::vector<std::pair<float, const OctreeNode*> > nodeHeap;
+            int first = (int)((int64)queryNum * range.start / chunkNum);
+            int last = (int)((int64)queryNum * range.end / chunkNum);
+            for(int i = first; i < last; i++)
             {
-                traverseRecurseBFS(node->children[childIndex], f);
+                int q = order[i];
+                if(rootNode == nullptr ||
+                   !approximateNNSearchImpl(queries[q], squareBound, maxLeafVisits, nodeHeap, points[q], squareDists[q]))
+                {
+                    points[q] = Point3f(0, 0, 0);
+                    squareDists[q] = std::numeric_limits<float>::infinity();
+                }
             }
+        });
+    }
 
-            if(!f(node)) return;
+    /** @brief Append the nodes at depth in the subtree of node, and the leaves above it, in child order so that
+     * they follow the Morton order.
+     */
+    static void collectLevelCells(const OctreeNode* node, int depth, std::vector<const OctreeNode*>& cells)
+    {
+        std::vector<const OctreeNode*> stack(1, node);
+        while(!stack.empty())
+        {
+            node = stack.back();
+            stack.pop_back();
+            if(node->depth == depth || node->isLeaf)
+            {
+                cells.push_back(node);
+                continue;
+            }
+            for(int i = OctreeNode::childNum - 1; i >= 0; i--)
+            {
+                if(node->children[i] != nullptr)
+                    stack.push_back(node->children[i]);
+            }
         }
     }
 
-    void Octree::traverseRecurseDFS( OctreeNode* &node, const std::function<bool ( OctreeNode*&)>&f )
+    void Octree::voxelDownsample(std::vector<Point3f>& downsampledPoints, int depth) const
     {
+        std::vector<int> counts;
+        getLevelPoints(depth, downsampledPoints, counts);
+    }
 
-        if(node == nullptr)
+    void Octree::getLevelPoints(int depth, std::vector<Point3f>& points, std::vector<int>& counts) const
+    {
+        points.clear();
+        counts.clear();
+        if(rootNode == nullptr)
         {
             return;
         }
-        else
+        if(depth < 0 || depth > maxDepth)
         {
-            if(!f(node)) return;
+            depth = maxDepth;
+        }
 
-            for(size_t childIndex = 0; childIndex < childNum; ++childIndex)
+        std::vector<const OctreeNode*> cells;
+        collectLevelCells(rootNode, depth, cells);
+
+        // The cells are disjoint subtrees, their aggregates can be computed on parallel threads.
+        const int cellNum = (int)cells.size();
+        std::vector<OctreeAggregate> aggregates(cellNum);
+        const int chunkNum = std::min(std::max(cv::getNumThreads(), 1) * 4, cellNum);
+        parallel_for_(Range(0, chunkNum), [&](const Range& range)
+        {
+            int first = (int)((int64)cellNum * range.start / chunkNum);
+            int last = (int)((int64)cellNum * range.end / chunkNum);
+            for(int c = first; c < last; c++)
             {
-                traverseRecurseDFS(node->children[childIndex], f);
+                aggregates[c] = getAggregate(cells[c]);
+            }
+        });
+
+        points.reserve(cellNum);
+        counts.reserve(cellNum);
+        for(const OctreeAggregate& aggregate : aggregates)
+        {
+            if(aggregate.count > 0)
+            {
+                points.push_back(aggregate.getCentroid());
+                counts.push_back((int)aggregate.count);
             }
         }
     }
 
-    OctreeNode* Octree::index(const Point3f& point)
+    int Octree::radiusNNSearchAtDepth(int depth, const Point3f& query, float radius, std::vector<Point3f>& pointSet,
+                                      std::vector<float>& squareDistSet) const
     {
-        if(isPointInBound(point))
+        pointSet.clear();
+        squareDistSet.clear();
+        if(rootNode == nullptr || radius < 0)
         {
-            return this->index(point, rootNode);
+            return 0;
         }
-        else
+        if(depth < 0 || depth > maxDepth)
         {
-            return nullptr;
+            depth = maxDepth;
         }
-    }
 
-    OctreeNode* Octree::index(const Point3f& point, OctreeNode*& node) const
-    {
+        OCTREE_QUERY_STAT(queries, 1);
+        std::vector<std::pair<float, Point3f> > candidates;
+        radiusNNSearchAtDepthRecurse(rootNode, depth, query, radius * radius, candidates);
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const std::pair<float, Point3f>& a, const std::pair<float, Point3f>& b)
+                  {
+                      return a.first < b.first;
+                  });
 
-        if(node == nullptr)
+        pointSet.resize(candidates.size());
+        squareDistSet.resize(candidates.size());
+        for(size_t i = 0; i < candidates.size(); i++)
         {
-         return nullptr;
+            squareDistSet[i] = candidates[i].first;
+            pointSet[i] = candidates[i].second;
         }
+        return (int)candidates.size();
+    }
 
-        if(node->isLeaf)
+    void Octree::radiusNNSearchAtDepthRecurse(const OctreeNode* node, int depth, const Point3f& query,
+                                              float squareRadius,
+                                              std::vector<std::pair<float, Point3f> >& candidates) const
+    {
+        OCTREE_QUERY_STAT(nodesVisited, 1);
+        if(node->depth == depth || node->isLeaf)
         {
-            for(int i = 0; i < node->pointList.size(); i++ )
+            const OctreeAggregate aggregate = getAggregate(node);
+            if(aggregate.count > 0)
             {
-                if((point.x == node->pointList[i]->x) &&
-                        (point.y == node->pointList[i]->y) &&
-                        (point.z == node->pointList[i]->z)
-                )
+                Point3f centroid = aggregate.getCentroid();
+                float dist = squareDist(query, centroid);
+                if(dist <= squareRadius)
                 {
-                    return node;
+                    candidates.emplace_back(dist, centroid);
                 }
             }
-            return nullptr;
+            return;
         }
 
-        if(this->isPointInBound(point, node->origin, node->size))
+        float childDists[childNum];
+        squareDistToChildren(query, node, childDists);
+        OCTREE_QUERY_STAT(boundTests, childNum);
+        for(size_t childIndex = 0; childIndex < childNum; childIndex++)
         {
-            double childSize = node->size / 2.0;
-            size_t xIndex = point.x < node->origin.x+ childSize ? 0 : 1;
-            size_t yIndex = point.y < node->origin.y + childSize ? 0 : 1;
-            size_t zIndex = point.z < node->origin.z + childSize ? 0 : 1;
-            size_t childIndex = xIndex + yIndex * 2 + zIndex * 4;
-
-            if(node->children[childIndex] != nullptr)
+            const OctreeNode* child = node->children[childIndex];
+            if(child != nullptr && childDists[childIndex] <= squareRadius)
             {
-                return this->index(point, node->children[childIndex]);
+                radiusNNSearchAtDepthRecurse(child, depth, query, squareRadius, candidates);
             }
         }
-        return nullptr;
     }
 
-    bool Octree::deletePoint(Point3f& point)
+    void Octree::KNNSearchAtDepth(int depth, const Point3f& query, const int K, std::vector<Point3f>& pointSet,
+                                  std::vector<float>& squareDistSet) const
     {
-        OctreeNode* node = index(point, rootNode);
+        typedef std::pair<float, const OctreeNode*> NodeEntry;
+        typedef std::greater<NodeEntry> NodeCompare;
+        typedef std::pair<float, Point3f> PointEntry;
+
+        pointSet.clear();
+        squareDistSet.clear();
+        if(rootNode == nullptr || K <= 0)
+        {
+            return;
+        }
+        if(depth < 0 || depth > maxDepth)
+        {
+            depth = maxDepth;
+        }
+
+        // The KNNSearchImpl loop, where a node at the depth of the level is a single point, its centroid. The
+        // centroid is in the cube of the node, so the cube distance still bounds it.
+        std::vector<NodeEntry> nodeHeap;
+        std::vector<PointEntry> best;
+        auto worseFirst = [](const PointEntry& a, const PointEntry& b)
+        {
+            return a.first < b.first;
+        };
 
-        if(node != nullptr)
+        OCTREE_QUERY_STAT(queries, 1);
+        OCTREE_QUERY_STAT(boundTests, 1);
+        nodeHeap.emplace_back(squareDistToNode(query, rootNode), rootNode);
+        while(!nodeHeap.empty())
         {
-            for(int i = 0; i < node->pointList.size(); i++)
+            std::pop_heap(nodeHeap.begin(), nodeHeap.end(), NodeCompare());
+            NodeEntry entry = nodeHeap.back();
+            nodeHeap.pop_back();
+            if((int)best.size() == K && entry.first > best.front().first)
+            {
+                break;
+            }
+
+            const OctreeNode* node = entry.second;
+            OCTREE_QUERY_STAT(nodesVisited, 1);
+            if(node->depth == depth || node->isLeaf)
+            {
+                const OctreeAggregate aggregate = getAggregate(node);
+                if(aggregate.count == 0)
+                {
+                    continue;
+                }
+                Point3f centroid = aggregate.getCentroid();
+                float dist = squareDist(query, centroid);
+                if((int)best.size() < K)
+                {
+                    best.emplace_back(dist, centroid);
+                    std::push_heap(best.begin(), best.end(), worseFirst);
+                }
+                else if(dist < best.front().first)
+                {
+                    std::pop_heap(best.begin(), best.end(), worseFirst);
+                    best.back() = PointEntry(dist, centroid);
+                    std::push_heap(best.begin(), best.end(), worseFirst);
+                }
+                continue;
+            }
+
+            float childDists[childNum];
+            squareDistToChildren(query, node, childDists);
+            OCTREE_QUERY_STAT(boundTests, childNum);
+            for(size_t childIndex = 0; childIndex < childNum; childIndex++)
             {
-                if((point.x == node->pointList[i]->x) &&
-                   (point.y == node->pointList[i]->y) &&
-                   (point.z == node->pointList[i]->z)
-                        )
+                const OctreeNode* child = node->children[childIndex];
+                if(child == nullptr)
+                {
+                    continue;
+                }
+                float dist = childDists[childIndex];
+                if((int)best.size() < K || dist <= best.front().first)
                 {
-                    node->pointList.erase(node->pointList.begin() + i);
+                    nodeHeap.emplace_back(dist, child);
+                    std::push_heap(nodeHeap.begin(), nodeHeap.end(), NodeCompare());
                 }
             }
-            return deletePointRecurse(node);
         }
-        else
+
+        std::sort_heap(best.begin(), best.end(), worseFirst);
+        pointSet.resize(best.size());
+        squareDistSet.resize(best.size());
+        for(size_t i = 0; i < best.size(); i++)
         {
-            return false;
+            squareDistSet[i] = best[i].first;
+            pointSet[i] = best[i].second;
         }
     }
 
-
-    bool Octree::deletePointRecurse(OctreeNode*& node)
+    int Octree::KNNSearchImpl(const Point3f& query, int K, std::vector<std::pair<float, const OctreeNode*> >& nodeHeap,
+                              std::vector<std::pair<float, const Point3f*> >& best, Point3f* points, float* squareDists) const
     {
-        if(node == nullptr)
-            return false;
-        if(node->isLeaf)
+        typedef std::pair<float, const OctreeNode*> NodeEntry;
+        typedef std::greater<NodeEntry> NodeCompare;
+
+        // Nodes to visit, closest first, and the K best points found so far, worst first.
+        nodeHeap.clear();
+        best.clear();
+
+        OCTREE_QUERY_STAT(queries, 1);
+        OCTREE_QUERY_STAT(boundTests, 1);
+        nodeHeap.emplace_back(squareDistToNode(query, rootNode), rootNode);
+        while(!nodeHeap.empty())
         {
-            if( !node->pointList.empty())
+            std::pop_heap(nodeHeap.begin(), nodeHeap.end(), NodeCompare());
+            NodeEntry entry = nodeHeap.back();
+            nodeHeap.pop_back();
+            if((int)best.size() == K && entry.first > best.front().first)
             {
-                OctreeNode* parent = node->parent;
-                parent->children[node->parentIndex] = nullptr;
-                delete node;
+                break;
+            }
 
-                return deletePointRecurse(parent);
+            const OctreeNode* node = entry.second;
+            OCTREE_QUERY_STAT(nodesVisited, 1);
+            if(node->isLeaf)
+            {
+                size_t pointNum = leafPointCount(node);
+                OCTREE_QUERY_STAT(leafPointsScanned, pointNum);
+                for(size_t i = 0; i < pointNum; i++)
+                {
+                    const Point3f* point = leafPoint(node, i);
+                    float dist = squareDist(query, *point);
+                    if((int)best.size() < K)
+                    {
+                        best.emplace_back(dist, point);
+                        std::push_heap(best.begin(), best.end());
+                    }
+                    else if(dist < best.front().first)
+                    {
+                        std::pop_heap(best.begin(), best.end());
+                        best.back() = std::make_pair(dist, point);
+                        std::push_heap(best.begin(), best.end());
+                    }
+                }
+                continue;
             }
-            else
+
+            float childDists[childNum];
+            squareDistToChildren(query, node, childDists);
+            OCTREE_QUERY_STAT(boundTests, childNum);
+            for(size_t childIndex = 0; childIndex < childNum; childIndex++)
             {
-                return true;
+                const OctreeNode* child = node->children[childIndex];
+                if(child == nullptr)
+                {
+                    continue;
+                }
+                float dist = childDists[childIndex];
+                if((int)best.size() < K || dist <= best.front().first)
+                {
+                    nodeHeap.emplace_back(dist, child);
+                    std::push_heap(nodeHeap.begin(), nodeHeap.end(), NodeCompare());
+                }
             }
         }
-        else
+
+        std::sort_heap(best.begin(), best.end());
+        for(size_t i = 0; i < best.size(); i++)
+        {
+            squareDists[i] = best[i].first;
+            points[i] = *best[i].second;
+        }
+        return (int)best.size();
+    }
+
+    bool Octree::approximateNNSearchImpl(const Point3f& query, float squareBound, int maxLeafVisits,
+                                         std::vector<std::pair<float, const OctreeNode*> >& nodeHeap, Point3f& nearest,
+                                         float& nearestSquareDist) const
+    {
+        typedef std::pair<float, const OctreeNode*> NodeEntry;
+        typedef std::greater<NodeEntry> NodeCompare;
+
+        // The KNNSearchImpl of K = 1, with the nodes pruned against the best distance shrunk by (1 + epsilon)^2.
+        nodeHeap.clear();
+        const Point3f* best = nullptr;
+        float bestDist = std::numeric_limits<float>::infinity();
+        int leafVisits = 0;
+
+        OCTREE_QUERY_STAT(queries, 1);
+        OCTREE_QUERY_STAT(boundTests, 1);
+        nodeHeap.emplace_back(squareDistToNode(query, rootNode), rootNode);
+        while(!nodeHeap.empty())
         {
-            bool deleteFlag = true;
+            std::pop_heap(nodeHeap.begin(), nodeHeap.end(), NodeCompare());
+            NodeEntry entry = nodeHeap.back();
+            nodeHeap.pop_back();
+            if(entry.first * squareBound > bestDist)
+            {
+                break;
+            }
 
-            for(int i = 0; i< childNum; i++) // only all children was deleted, can we delete the tree node.
+            const OctreeNode* node = entry.second;
+            OCTREE_QUERY_STAT(nodesVisited, 1);
+            if(node->isLeaf)
             {
-                if(node->children[i] != nullptr)
+                size_t pointNum = leafPointCount(node);
+                OCTREE_QUERY_STAT(leafPointsScanned, pointNum);
+                for(size_t i = 0; i < pointNum; i++)
+                {
+                    const Point3f* p = leafPoint(node, i);
+                    float dist = squareDist(query, *p);
+                    if(dist < bestDist)
+                    {
+                        bestDist = dist;
+                        best = p;
+                    }
+                }
+                leafVisits++;
+                if(maxLeafVisits > 0 && leafVisits >= maxLeafVisits && best != nullptr)
                 {
-                    deleteFlag = false;
                     break;
                 }
+                continue;
             }
 
-            if(deleteFlag)
+            float childDists[childNum];
+            squareDistToChildren(query, node, childDists);
+            OCTREE_QUERY_STAT(boundTests, childNum);
+            for(size_t childIndex = 0; childIndex < childNum; childIndex++)
             {
-                OctreeNode* parent = node->parent;
-                node = nullptr;
-                return deletePointRecurse(parent);
-            }
-            else
-            {
-                return true;
+                const OctreeNode* child = node->children[childIndex];
+                if(child != nullptr && childDists[childIndex] * squareBound <= bestDist)
+                {
+                    nodeHeap.emplace_back(childDists[childIndex], child);
+                    std::push_heap(nodeHeap.begin(), nodeHeap.end(), NodeCompare());
+                }
             }
         }
+
+        if(best == nullptr)
+        {
+            return false;
+        }
+        nearest = *best;
+        nearestSquareDist = bestDist;
+        return true;
     }
 
-    void Octree::insertPointRecurse( OctreeNode*& node,  Point3f& point)
+    void Octree::sortByMortonCode(const std::vector<Point3f>& points, std::vector<int>& order) const
     {
-        if(!isPointInBound(point, node->origin, node->size))
+        CV_Assert(maxDepth >= 0 && maxDepth <= MORTON_MAX_DEPTH);
+
+        size_t pointNum = points.size();
+        std::vector<uint64> keys(pointNum), keysTmp(pointNum);
+        std::vector<int> orderTmp(pointNum);
+        order.resize(pointNum);
+
+        // Points outside of the root cube are clamped to the border cells, which is fine for ordering.
+        const int chunkNum = (int)std::min((size_t)std::max(cv::getNumThreads(), 1) * 4, pointNum);
+        parallel_for_(Range(0, chunkNum), [&](const Range& range)
         {
-            CV_Error(Error::StsBadArg, "The point is out of boundary!");
+            size_t begin = pointNum * range.start / chunkNum;
+            size_t end = pointNum * range.end / chunkNum;
+            computeMortonCodes(&points[begin], end - begin, origin, size, maxDepth, &keys[begin]);
+        });
+        for(size_t idx = 0; idx < pointNum; idx++)
+        {
+            order[idx] = (int)idx;
         }
+        radixSortMorton(keys.data(), order.data(), pointNum, 3 * maxDepth, keysTmp.data(), orderTmp.data());
+    }
 
-        if(node->depth == maxDepth)
+    void Octree::index(const std::vector<Point3f>& points, std::vector<OctreeNode*>& nodes) const
+    {
+        nodes.resize(points.size());
+        if(points.empty())
         {
-            node->isLeaf = true;
-            node->pointList.push_back(&point);
             return;
         }
 
-        double childSize = node->size / 2.0;
-        size_t xIndex = point.x < node->origin.x+ childSize ? 0 : 1;
-        size_t yIndex = point.y < node->origin.y + childSize ? 0 : 1;
-        size_t zIndex = point.z < node->origin.z + childSize ? 0 : 1;
-        size_t childIndex = xIndex + yIndex * 2 + zIndex * 4;
+        std::vector<int> order;
+        sortByMortonCode(points, order);
 
-        if(node->children[childIndex] == nullptr)
+        const int pointNum = (int)points.size();
+        const int chunkNum = std::min(std::max(cv::getNumThreads(), 1) * 4, pointNum);
+        OCTREE_PARALLEL_QUERY_STATS(queryStats);
+        parallel_for_(Range(0, chunkNum), [&](const Range& range)
         {
-            Point3f childOrigin = node->origin + Point3f(xIndex * childSize,yIndex * childSize, zIndex * childSize);
-            node->children[childIndex] = new OctreeNode(node->depth + 1, childSize, childOrigin, childIndex);
-            node->children[childIndex]->parent = node;
-        }
-        insertPointRecurse(node->children[childIndex], point);
+            OCTREE_WORKER_QUERY_STATS(queryStats);
+            // The path of the previous point, from the root node down to the deepest node reached.
+            std::vector<OctreeNode*> path(maxDepth + 1);
+            int pathDepth = -1;
+            uint64 prevKey = 0;
 
+            int first = (int)((int64)pointNum * range.start / chunkNum);
+            int last = (int)((int64)pointNum * range.end / chunkNum);
+            for(int i = first; i < last; i++)
+            {
+                const Point3f& point = points[order[i]];
+                OctreeNode*& result = nodes[order[i]];
+                result = nullptr;
+
+                OCTREE_QUERY_STAT(queries, 1);
+                OCTREE_QUERY_STAT(boundTests, 1);
+                if(rootNode == nullptr || !isPointInBound(point))
+                {
+                    continue;
+                }
+
+                // Keep the part of the previous path above the level where the Morton codes diverge.
+                uint64 key = mortonCode(point);
+                uint64 diff = key ^ prevKey;
+                prevKey = key;
+                if(pathDepth < 0)
+                {
+                    path[0] = rootNode;
+                    pathDepth = 0;
+                }
+                else if(diff != 0)
+                {
+                    int highestBit = 63;
+                    while(!((diff >> highestBit) & 1))
+                    {
+                        highestBit--;
+                    }
+                    pathDepth = std::min(pathDepth, maxDepth - highestBit / 3 - 1);
+                }
+
+                // Then descend like index(const Point3f&, OctreeNode*&).
+                OctreeNode* node = path[pathDepth];
+                while(!node->isLeaf)
+                {
+                    int childIndex = (int)((key >> (3 * (maxDepth - node->depth - 1))) & 7);
+                    node = node->children[childIndex];
+                    if(node == nullptr)
+                    {
+                        break;
+                    }
+                    OCTREE_QUERY_STAT(nodesVisited, 1);
+                    path[++pathDepth] = node;
+                }
+
+                if(node != nullptr && findPointInLeaf(node, point) >= 0)
+                {
+                    result = node;
+                }
+            }
+        });
     }
 }
\ No newline at end of file
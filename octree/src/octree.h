@@ -28,6 +28,11 @@
 #ifndef OPENCV_OCTREE_OCTREE_H
 #define OPENCV_OCTREE_OCTREE_H
 
+#include <array>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include "opencv2/core.hpp"
 
@@ -35,6 +40,55 @@ namespace cv {
 //! @addtogroup 3d
 //! @{
 
+    class OctreeNodePool;
+    class MappedFile;
+
+    /** @brief Running sums of the points below an OctreeNode, see Octree::getAggregate().
+    The sums are taken relative to the origin of the node, which keeps them accurate far from the coordinate origin.
+    */
+    struct CV_EXPORTS OctreeAggregate
+    {
+        //! The number of points.
+        int64 count = 0;
+
+        //! The point the sums are relative to.
+        Point3f reference;
+
+        //! The sum of the points minus reference.
+        Vec3d sum;
+
+        //! The sum of the outer products of the points minus reference.
+        Matx33d sumOuter;
+
+        //! The sums of the attributes of the points, see Octree::setAggregateAttributes().
+        std::vector<double> attributeSums;
+
+        //! Whether the sums are up to date. The ancestors of a modified leaf are only summed again on request.
+        bool valid = false;
+
+        //! Empty the sums, relative to _reference and with attributeNum attributes.
+        void reset(const Point3f& _reference, int attributeNum);
+
+        /** @brief Add a point, or remove it with a weight of -1.
+         * @param point The point.
+         * @param attributes Its attributes, or NULL for zeros.
+         * @param weight 1 or -1.
+         */
+        void accumulate(const Point3f& point, const float* attributes, int weight);
+
+        //! Add the sums of another aggregate, with the same attributes.
+        void merge(const OctreeAggregate& other);
+
+        //! The mean of the points.
+        Point3f getCentroid() const;
+
+        //! The covariance of the points, normalized by their number.
+        Matx33d getCovariance() const;
+
+        //! The mean of the attribute of index attribute.
+        double getAttributeMean(int attribute) const;
+    };
+
     /** @brief OctreeNode for Octree.
 
     The class OctreeNode represents the node of the octree. Each node contains 8 children, which are used to divide the
@@ -65,7 +119,7 @@ namespace cv {
         /**
          * There are multiple constructors to create OctreeNode.
          * */
-        OctreeNode():children(8, nullptr), depth(0), size(0), origin(0,0,0), parentIndex(-1){}
+        OctreeNode():depth(0), size(0), origin(0,0,0), parentIndex(-1){ children.fill(nullptr); }
 
 
         /** @overload
@@ -84,12 +138,14 @@ namespace cv {
 
         /** @brief clear the OctreeNode and its children.
          * This function will delete the current node and all child nodes. And set the pointer to itself
-         * in its parent node to NULL.
+         * in its parent node to NULL. Nodes owned by an OctreeNodePool are handed back to the pool, and
+         * clearing a pooled root node resets the whole pool at once without walking the tree. A node without a
+         * parent that is not a root node, such as a leaf of a HashedOctree, is owned by its container and is kept.
          */
         void clear();
 
         //! Contains 8 pointers to its 8 children.
-        std::vector<OctreeNode *> children;
+        std::array<OctreeNode *, 8> children;
 
         //! Point to the parent node of the current node. The root node has no parent node and the value is NULL.
         OctreeNode* parent{};
@@ -114,10 +170,188 @@ namespace cv {
         //! If the OctreeNode is LeafNode.
         bool isLeaf = false;
 
+        /** @brief Occupancy trees only, see OccupancyOctree. The log-odds of occupancy of the cube in fixed point,
+         * the summary of the children for an intermediate node. It fits in the padding after isLeaf.
+         */
+        short logOdds = 0;
+
         //! Contains pointers to all point cloud data in this node.
         std::vector<Point3f *> pointList;
+
+        /** @brief Compact trees only, see OCTREE_BUILD_COMPACT. The points of a leaf node are stored contiguously
+         * in the tree, from pointOffset to pointOffset + pointCount. pointList is empty.
+         */
+        int pointOffset = 0;
+
+        //! Compact trees only. The number of points of a leaf node.
+        int pointCount = 0;
+
+        /** @brief The cached hash of the points below the node, see Octree::updateHashes(). 0 until it is computed,
+         * and reset to 0 on the path of every insertion and deletion.
+         */
+        uint64 hash = 0;
+
+        //! The cached aggregate of the points below the node, see Octree::updateAggregates(). NULL until computed.
+        std::unique_ptr<OctreeAggregate> aggregate;
+
+        //! The pool owning this node, or NULL if the node was created with new.
+        OctreeNodePool* pool = nullptr;
+    };
+
+    /** @brief Arena that owns the OctreeNodes of an Octree.
+
+    Nodes are carved out of fixed-size blocks, so building a tree costs one allocation per block instead
+    of one per node, and the nodes of a tree sit next to each other in memory. Released nodes go to a free
+    list and are reused by the following allocations. reset() drops all the nodes at once in O(1): the blocks
+    are kept, together with the pointList capacity of their nodes, and reused by the next build.
+    */
+    class CV_EXPORTS OctreeNodePool{
+    public:
+
+        OctreeNodePool():owner(this), usedBlocks(0), blockUsed(0), liveCount(0){}
+
+        /** @brief Create a pool whose nodes are handed over to _owner with merge() once they are built.
+         * The nodes are marked as owned by _owner from the start. This is used to build subtrees on
+         * several threads, each with its own pool.
+         */
+        explicit OctreeNodePool(OctreeNodePool* _owner):owner(_owner), usedBlocks(0), blockUsed(0), liveCount(0){}
+
+        OctreeNodePool(const OctreeNodePool&) = delete;
+        OctreeNodePool& operator=(const OctreeNodePool&) = delete;
+
+        /** @brief Get a node from the pool and initialize it like OctreeNode(_depth, _size, _origin, _parentIndex).
+         * @return The pointer to the node, it stays valid until the node is released or the pool is reset.
+         */
+        OctreeNode* allocate(int _depth, double _size, Point3f _origin, int _parentIndex);
+
+        //! Give a single node back to the pool. The node will be reused by the next allocate().
+        void release(OctreeNode* node);
+
+        //! Release all the nodes of the pool at once. The memory is kept for reuse.
+        void reset();
+
+        /** @brief Move all the blocks of src into this pool, the nodes of src stay where they are.
+         * src must have been created with this pool as owner, and is empty afterwards.
+         */
+        void merge(OctreeNodePool& src);
+
+        //! The number of nodes currently handed out by the pool.
+        size_t nodeCount() const;
+
+        //! The memory of all the blocks of the pool, spare ones included, in bytes.
+        size_t capacityBytes() const;
+
+    private:
+        //! The number of nodes in each block.
+        const static size_t blockSize = 1024;
+
+        //! The pool recorded in OctreeNode::pool of the allocated nodes.
+        OctreeNodePool* owner;
+
+        //! The blocks in use come first, the last one of them is partially filled. Spare blocks follow.
+        std::vector<std::unique_ptr<OctreeNode[]> > blocks;
+
+        //! The number of blocks in use.
+        size_t usedBlocks;
+
+        //! The number of nodes carved out of the last block in use.
+        size_t blockUsed;
+
+        //! The number of nodes currently handed out.
+        size_t liveCount;
+
+        std::vector<OctreeNode*> freeList;
     };
 
+    //! Flags selecting how Octree::convertFromPointCloud builds the tree.
+    enum OctreeBuildFlags
+    {
+        //! Insert the points one by one, every insertion walks down from the root node.
+        OCTREE_BUILD_INCREMENTAL = 0,
+        /** Compute the Morton (Z-order) code of every point at maxDepth resolution, radix sort the codes
+         * and emit all the nodes in a single linear pass over the sorted points. maxDepth is limited to 21.
+         */
+        OCTREE_BUILD_MORTON = 1,
+        /** Morton build on all the threads of cv::parallel_for_. The points are partitioned by the Morton prefix
+         * of a level that gives every thread several subtrees, which are then sorted and emitted concurrently and
+         * linked under the shared top levels. The tree is the same as with OCTREE_BUILD_MORTON. Implies it.
+         */
+        OCTREE_BUILD_PARALLEL = 2,
+        /** Build a compact tree, implies OCTREE_BUILD_MORTON. The tree keeps its own copy of the points, sorted so that
+         * the points of each leaf node are contiguous, and leaves refer to them by OctreeNode::pointOffset and
+         * OctreeNode::pointCount instead of pointList. The source point cloud is not referenced after the build.
+         * Points can not be inserted in a compact tree.
+         */
+        OCTREE_BUILD_COMPACT = 4,
+        /** Compute and sort the Morton codes on the OpenCL device of cv::ocl, then emit the nodes on the CPU like
+         * OCTREE_BUILD_MORTON, which it implies. The tree is the same. Without the OCTREE_WITH_OPENCL build option
+         * or an OpenCL device, the codes are computed on the CPU. Takes precedence over OCTREE_BUILD_PARALLEL.
+         */
+        OCTREE_BUILD_OPENCL = 8
+    };
+
+    //! Values returned by the visitors of Octree::traverseBFS and Octree::traverseDFS.
+    enum OctreeTraversalResult
+    {
+        //! Go on with the children of the node.
+        OCTREE_TRAVERSAL_CONTINUE = 0,
+        //! Do not visit the children of the node, go on with the rest of the tree.
+        OCTREE_TRAVERSAL_SKIP_CHILDREN = 1,
+        //! End the traversal.
+        OCTREE_TRAVERSAL_STOP = 2
+    };
+
+    //! Primitives of the meshes exported by Octree::exportNodeBoxes.
+    enum OctreeMeshMode
+    {
+        //! 12 triangles per box, with the outward faces counter-clockwise.
+        OCTREE_MESH_TRIANGLES = 0,
+        //! The 12 edges of each box, as pairs of indices.
+        OCTREE_MESH_LINES = 1
+    };
+
+    //! The shape and the memory usage of an Octree, see Octree::getStats.
+    struct CV_EXPORTS OctreeStats
+    {
+        //! The number of nodes at every depth, from 0 to maxDepth.
+        std::vector<size_t> nodesPerDepth;
+
+        size_t nodeCount = 0;
+        size_t leafCount = 0;
+        size_t pointCount = 0;
+
+        //! Bin i counts the leaves holding from 2^i to 2^(i+1) - 1 points, bin 0 also counts the empty leaves.
+        std::vector<size_t> leafOccupancy;
+
+        double meanPointsPerLeaf = 0;
+        size_t maxPointsPerLeaf = 0;
+
+        //! The nodes in use, their children pointers included.
+        size_t nodeBytes = 0;
+        //! The blocks of the node pool, free and spare nodes included.
+        size_t poolBytes = 0;
+        //! The capacity of the pointList of the leaves.
+        size_t pointListBytes = 0;
+        //! The points and indices owned by a compact tree. A memory mapped file is not counted.
+        size_t compactBytes = 0;
+        //! poolBytes + pointListBytes + compactBytes.
+        size_t totalBytes = 0;
+    };
+
+    /** @brief Counters of the work done by the queries, see Octree::getQueryStats.
+     * They are only collected when the library is built with OCTREE_ENABLE_QUERY_STATS, and stay 0 otherwise.
+     */
+    struct CV_EXPORTS OctreeQueryStats
+    {
+        //! The number of queries: point lookups, radius and K nearest neighbor searches.
+        uint64 queries = 0;
+        //! The nodes reached, leaves included.
+        uint64 nodesVisited = 0;
+        //! The point-in-cube and point-to-cube distance tests.
+        uint64 boundTests = 0;
+        //! The points of the leaves compared with the query.
+        uint64 leafPointsScanned = 0;
+    };
 
     /** @brief Octree for 3D vision.
    In 3D vision filed, the Octree is used to process and accelerate the pointcloud data. The class Octree represents
@@ -130,7 +364,7 @@ namespace cv {
     public:
 
         //! Default constructor.
-        Octree():maxDepth(0), size(0), origin(0,0,0){}
+        Octree():maxDepth(0), size(0), origin(0,0,0), nodePool(makePtr<OctreeNodePool>()){}
 
         /** @overload
          * @brief Create an empty Octree and set the maximum depth.
@@ -142,14 +376,33 @@ namespace cv {
          *  @brief Create an Octree from the PointCloud data with the specific max depth.
          * @param _maxDepth The max depth of the Octree.
          * @param _pointCloud Point cloud data.
+         * @param flags Build flags, see OctreeBuildFlags.
          */
-        Octree(int _maxDepth, std::vector<Point3f>& _pointCloud);
+        Octree(int _maxDepth, std::vector<Point3f>& _pointCloud, int flags = OCTREE_BUILD_INCREMENTAL);
 
         /** @overload
          * @brief Deep copy a new tree with the same structure.
+         * The nodes are copied. The leaves of a non-compact copy point to the same point cloud data as src,
+         * a compact copy has its own points, except for a memory mapped src whose mapping is shared.
+         * @param src Source Octree
+         */
+        Octree(const Octree& src);
+
+        /** @overload
+         * @brief Take over the nodes and the points of src without copying them.
+         * src is left as an empty tree with a max depth of 0, which can be built again.
          * @param src Source Octree
          */
-        Octree(Octree& src);
+        Octree(Octree&& src) noexcept;
+
+        //! Deep copy src, see Octree(const Octree&). The previous nodes of the tree are released.
+        Octree& operator=(const Octree& src);
+
+        //! Take over the nodes and the points of src, see Octree(Octree&&). The previous nodes are released.
+        Octree& operator=(Octree&& src) noexcept;
+
+        //! Exchange the contents of two trees in O(1), the nodes stay where they are.
+        void swap(Octree& other) noexcept;
 
         /** @overload
          * @brief Create an empty Octree.
@@ -159,8 +412,8 @@ namespace cv {
          */
         Octree(int _maxDepth, double _size, Point3f _origin);
 
-        //! destructor - calls release()
-        ~Octree()= default;;
+        //! destructor - the nodes are released with the pool owning them.
+        ~Octree()= default;
 
 
         /** @brief Insert a point data to a OctreeNode.
@@ -170,13 +423,63 @@ namespace cv {
          */
         void insertPoint(OctreeNode*& node, Point3f& point);
 
+        /** @brief Insert a batch of points, growing the root cube first if auto expansion is enabled.
+         * The points are inserted in Morton order, and each one starts from the deepest node it shares with the
+         * previous one instead of from the root node. The tree is the same as when inserting the points one by one,
+         * and the leaves point to the given points, which must outlive the tree.
+         * @param points The points to insert.
+         * @param pointNum The number of points.
+         */
+        void insertPoints(Point3f* points, size_t pointNum);
+
+        //! @overload
+        void insertPoints(std::vector<Point3f>& points);
+
+        /** @brief Let insertions grow the root cube instead of rejecting the points out of it.
+         * When a point out of the root cube is inserted at the root node, the root is re-parented into a cube of twice
+         * its size, as many times as needed. The leaf size is kept, so maxDepth grows by one each time, up to 21.
+         * @param enable Enables or disables the expansion, it is disabled by default.
+         */
+        void setAutoExpand(bool enable);
+
+        //! returns true if insertions grow the root cube, see setAutoExpand().
+        bool getAutoExpand() const;
+
+        /** @brief Let a leaf hold several points before it is split, instead of sending every point down to maxDepth.
+         * A leaf holding more than capacity points hands them over to its children, which are split in turn while
+         * they overflow, down to maxDepth at most: maxDepth is the hard cap of the tree and leaves at maxDepth are
+         * never split. Dense regions are resolved finely and sparse ones stay shallow, so leaves may be at any depth.
+         * All the builds and insertions produce the same tree: a node is a leaf when it holds at most capacity
+         * points or is at maxDepth. Deleting points does not merge leaves back.
+         * Set it before building the tree, the existing leaves are not reorganized.
+         * @param capacity The number of points a leaf holds before it is split, 0 to always go down to maxDepth,
+         * which is the default.
+         */
+        void setLeafCapacity(size_t capacity);
+
+        //! returns the leaf capacity, see setLeafCapacity().
+        size_t getLeafCapacity() const;
+
 
         /** @brief Read point cloud data and create OctreeNode.
          * This function is only called when the octree is being created.
+         * With OCTREE_BUILD_MORTON, any existing node is dropped first, and the tree has the same nodes, child
+         * order and pointList order as with the incremental build.
+         * The root cube is fitted to the bounding box of the point cloud, see setBoundPadding().
          * @param pointCloud PointCloud data.
-         * @return Returns whether the creation is successful.
+         * @param flags Build flags, see OctreeBuildFlags.
+         * @return Returns whether the creation is successful, false for an empty point cloud.
          */
-        bool convertFromPointCloud(std::vector<Point3f> &pointCloud);
+        bool convertFromPointCloud(std::vector<Point3f> &pointCloud, int flags = OCTREE_BUILD_INCREMENTAL);
+
+        /** @overload
+         * @brief Create a compact tree from read-only point cloud data, such as a memory mapped file.
+         * OCTREE_BUILD_COMPACT is always added to the flags.
+         * @param points Point cloud data.
+         * @param pointNum The number of points.
+         * @param flags Build flags, see OctreeBuildFlags.
+         */
+        bool convertFromPointCloud(const Point3f* points, size_t pointNum, int flags = OCTREE_BUILD_COMPACT);
 
         /** @brief
          *
@@ -185,8 +488,30 @@ namespace cv {
          */
         static Point3f findCenterInPointCloud(std::vector<Point3f> &pointCloud) ;
 
+        //! @overload
+        static Point3f findCenterInPointCloud(const Point3f* points, size_t pointNum) ;
+
+        /** @brief Compute the axis-aligned bounding box of the point cloud in one parallel pass.
+         * @param points Point cloud data.
+         * @param pointNum The number of points.
+         * @param minBound Output, the minimum coordinates.
+         * @param maxBound Output, the maximum coordinates.
+         * @return Returns false if the point cloud is empty.
+         */
+        static bool findBoundingBox(const Point3f* points, size_t pointNum, Point3f& minBound, Point3f& maxBound);
+
+        /** @brief Set the margin left around the point cloud by convertFromPointCloud.
+         * The root cube is centered on the bounding box of the point cloud. Its size is the largest extent of the box,
+         * enlarged by padding times that extent on each side, so that later insertions close to the cloud still fit.
+         * @param padding The relative margin, 0 by default for the tightest cube.
+         */
+        void setBoundPadding(float padding);
+
+        //! The relative margin around the point cloud, see setBoundPadding().
+        float getBoundPadding() const;
+
         /** @brief Determine whether the point is within the space range of the specific cube.
-         *
+         * The faces of the cube belong to it.
          * @param point The point coordinates.
          * @param origin The coordinate of cube.
          * @param size The size of cube.
@@ -212,6 +537,88 @@ namespace cv {
         //! returns true if the rootnode is NULL.
         bool isEmpty() const;
 
+        /** @brief Compute the shape and the memory usage of the tree, with one traversal.
+         * @return The statistics, all 0 for an empty tree except poolBytes.
+         */
+        OctreeStats getStats() const;
+
+        /** @brief Get the query counters of the calling thread.
+         * The counters sum the queries of all the trees made by this thread since the last resetQueryStats(). The
+         * work of the worker threads of a batched query is added to the thread that called it. Reset, query, then
+         * read, to get the counters of a single query.
+         * Without OCTREE_ENABLE_QUERY_STATS at build time, the counters are always 0 and cost nothing.
+         */
+        static OctreeQueryStats getQueryStats();
+
+        //! Set the query counters of the calling thread to 0, see getQueryStats().
+        static void resetQueryStats();
+
+        /** @brief Save the tree to a binary file.
+         * The layout has no pointers: a header, the flat array of nodes in breadth-first order where the children
+         * of each node are contiguous, the point range of every leaf, then the points in leaf order and their
+         * indices in the source point cloud. The file uses the byte order of the machine.
+         * @param path The path of the file.
+         * @return Returns whether the saving is successful.
+         */
+        bool save(const String& path) const;
+
+        /** @brief Load a tree saved with save(). Any existing node is dropped first, unless the file is invalid:
+         * then the tree is left unchanged.
+         * The loaded tree is compact, see OCTREE_BUILD_COMPACT.
+         * @param path The path of the file.
+         * @param mapped If true, the file is mapped read-only and the points and their indices are used in place
+         * without copy, only the nodes are created. The tree is then read-only, and the mapping is released with
+         * the tree by clear() or the destructor.
+         * @return Returns whether the loading is successful.
+         */
+        bool load(const String& path, bool mapped = false);
+
+        /** @brief Encode the tree for transmission, as one occupancy byte per node above maxDepth.
+         * The nodes are written in breadth-first order, byte i of a node being set if it has the child i, or 0 for
+         * a leaf. The point count of every leaf follows, then every point quantized to residualBits bits per axis
+         * within the cube of its leaf. The geometry of the nodes is not stored, it is recomputed from the root cube.
+         * @param buffer Output, the encoded tree.
+         * @param residualBits The bits per axis of the points, from 0 to 16. With 0, only the leaf cubes are kept
+         * and every point is decoded at the center of its leaf.
+         * @param entropyCoding If true, the occupancy bytes and the point counts are range coded with adaptive
+         * models, which usually halves them. The residuals are always stored as is.
+         */
+        void encode(std::vector<uchar>& buffer, int residualBits = 10, bool entropyCoding = true) const;
+
+        /** @brief Decode a tree encoded with encode(). Any existing node is dropped first.
+         * The decoded tree is compact, see OCTREE_BUILD_COMPACT, and owns its points. The indices of the points are
+         * their positions in leaf order.
+         * @param data The encoded tree.
+         * @param dataSize The size of data in bytes.
+         * @return Returns whether the decoding is successful.
+         */
+        bool decode(const uchar* data, size_t dataSize);
+
+        //! @overload
+        bool decode(const std::vector<uchar>& buffer);
+
+        //! returns true if the tree was built with OCTREE_BUILD_COMPACT.
+        bool isCompact() const;
+
+        /** @brief Get the points of a leaf node of a compact tree.
+         * @param leaf A leaf node of this tree.
+         * @return The pointer to the leaf->pointCount points of the leaf.
+         */
+        const Point3f* getLeafPoints(const OctreeNode* leaf) const;
+
+        /** @brief Get the indices in the source point cloud of the points of a leaf node of a compact tree.
+         * @param leaf A leaf node of this tree.
+         * @return The pointer to leaf->pointCount indices, in the order of getLeafPoints().
+         */
+        const int* getLeafPointIndices(const OctreeNode* leaf) const;
+
+        /** @brief Get all the points of a compact tree, in leaf order.
+         * The points of a leaf are from leaf->pointOffset to leaf->pointOffset + leaf->pointCount. In a tree built
+         * with OCTREE_BUILD_COMPACT, the leaves are in Morton order and the points of a subtree are contiguous.
+         * @return The pointer to the points, NULL for a tree that is not compact.
+         */
+        const Point3f* getCompactPoints() const;
+
         /** @brief
          *  Reset all octree parameterDeleting a point from the octree actually deletes the corresponding element
          *  from the pointList in the corresponding leaf node. If the leaf node does not contain other points after
@@ -230,22 +637,50 @@ namespace cv {
 
         /** @overload
          *  @brief The default search range is in the entire tree.
+         * The tree is only read, so a Snapshot of a ConcurrentOctree can be indexed by its reader.
          * @param point
          * @return The pointer to the located OctreeNode.
          */
-        OctreeNode* index(const Point3f& point);
+        OctreeNode* index(const Point3f& point) const;
+
+        /** @overload
+         * @brief Locate the OctreeNodes of a batch of points.
+         * Each result is the same as index(const Point3f&). The points are visited in Morton order, in parallel,
+         * and each point starts from the deepest node it shares with the path of the previous one, instead of
+         * from the root node.
+         * @param points The points to be located.
+         * @param nodes Output, nodes[i] is the located OctreeNode of points[i], or NULL.
+         */
+        void index(const std::vector<Point3f>& points, std::vector<OctreeNode*>& nodes) const;
 
         /** @brief Delete a given point from the Octree.
-         * Delete the corresponding element from the pointList in the corresponding leaf node. If the leaf node
-         * does not contain other points after deletion, this node will be deleted. In the same way,
-         * its parent node may also be deleted if its last child is deleted.
+         * Remove one point with these coordinates from the corresponding leaf node, by moving the last point of
+         * the leaf into its place. If the leaf node does not contain other points after deletion, this node will
+         * be deleted. In the same way, its parent node may also be deleted if its last child is deleted.
          * @param point The point coordinates.
          * @return return ture if the point is deleted successfully.
          */
         bool deletePoint(Point3f& point);
 
+        /** @brief Delete a batch of points.
+         * Each point of the batch removes one point with the same coordinates, like deletePoint(). The points are
+         * located in parallel with index(), each leaf node is updated in a single pass, then the empty nodes are
+         * deleted bottom-up.
+         * @param points The coordinates of the points to delete.
+         * @return The number of points deleted.
+         */
+        size_t deletePoints(const std::vector<Point3f>& points);
+
+        /** @brief Delete all the points satisfying a predicate, then the empty nodes.
+         * @param predicate Called as predicate(const Point3f&) on every point, returns true for the points to delete.
+         * @return The number of points deleted.
+         */
+        template<typename Predicate>
+        size_t removeIf(Predicate&& predicate);
+
         /** @brief Traverse OctreeNode in BFS.
-         *
+         * The nodes are actually visited in post-order, children before their parent, see traverseBFS() for a
+         * level-order traversal.
          * @param node When node is the rootNode, traverse the entire Octree.
          * @param f The operations on the node.
          */
@@ -254,6 +689,291 @@ namespace cv {
         //! Traverse OctreeNode in DFS.
         void traverseRecurseDFS( OctreeNode*& node, const std::function<bool ( OctreeNode*&)>&f );
 
+        /** @brief Traverse the subtree of node in level order, with a queue.
+         * The nodes of each depth are visited before the deeper ones, the children in their index order.
+         * @param node When node is the rootNode, traverse the entire Octree.
+         * @param visitor Called as visitor(OctreeNode*) on every node, returns an OctreeTraversalResult.
+         * It is a template parameter so that the call can be inlined.
+         */
+        template<typename Visitor>
+        void traverseBFS(OctreeNode* node, Visitor&& visitor) const;
+
+        /** @brief Traverse the subtree of node in depth-first pre-order, with an explicit stack.
+         * A node is visited before its children, the children in their index order, i.e. in Morton order.
+         * @param node When node is the rootNode, traverse the entire Octree.
+         * @param visitor Called as visitor(OctreeNode*) on every node, returns an OctreeTraversalResult.
+         */
+        template<typename Visitor>
+        void traverseDFS(OctreeNode* node, Visitor&& visitor) const;
+
+        /** @brief Radius Nearest Neighbor Search in Octree.
+         * Search all points that are less than or equal to radius from the query point. Nodes whose cube
+         * is further than radius from the query are skipped as a whole.
+         * @param query Query point.
+         * @param radius Retrieved radius value.
+         * @param pointSet Point output. Contains searched points, sorted by distance in ascending order.
+         * @param squareDistSet Dist output. Contains the squared distance of the searched points.
+         * @return The number of points found.
+         */
+        int radiusNNSearch(const Point3f& query, float radius, std::vector<Point3f>& pointSet,
+                           std::vector<float>& squareDistSet) const;
+
+        /** @brief K Nearest Neighbor Search in Octree.
+         * Find the K nearest neighbors of the query point. Nodes are visited in the order of their distance to
+         * the query, and the search stops once the closest remaining node is further than the K-th point found.
+         * @param query Query point.
+         * @param K The number of neighbors to search.
+         * @param pointSet Point output. Contains K points, sorted by distance in ascending order. Fewer if
+         * the tree holds less than K points.
+         * @param squareDistSet Dist output. Contains the squared distance of the K points.
+         */
+        void KNNSearch(const Point3f& query, const int K, std::vector<Point3f>& pointSet,
+                       std::vector<float>& squareDistSet) const;
+
+        /** @overload
+         * @brief K Nearest Neighbor Search for a batch of query points.
+         * The queries are processed in Morton order, in parallel. The search state is reused from one query to
+         * the next, so nothing is allocated per query.
+         * @param queries Query points.
+         * @param K The number of neighbors to search, the outputs are empty for K <= 0 like for a single query.
+         * @param pointSet Point output of size queries.size() * K, the neighbors of queries[i] are stored from
+         * index i * K, sorted by distance in ascending order.
+         * @param squareDistSet Dist output of the same layout. When the tree holds less than K points, the missing
+         * neighbors have an infinite distance.
+         */
+        void KNNSearch(const std::vector<Point3f>& queries, const int K, std::vector<Point3f>& pointSet,
+                       std::vector<float>& squareDistSet) const;
+
+        /** @brief Approximate nearest neighbor search, for inner loops such as ICP correspondences.
+         * The nodes are visited closest first as in KNNSearch(), which starts with the leaf of the query and goes on
+         * with the leaves around it. The search stops once no remaining node can hold a point closer than the best
+         * one by more than a factor 1 + epsilon, or after maxLeafVisits leaves.
+         * @param query Query point.
+         * @param point Output, the point found.
+         * @param squareDist Output, its squared distance to the query.
+         * @param epsilon The distance of the point found is at most 1 + epsilon times the distance of the nearest
+         * point, unless the leaf budget runs out first. 0 gives the nearest point.
+         * @param maxLeafVisits The number of leaves to scan at most, 0 for no limit.
+         * @return false if the tree is empty.
+         */
+        bool approximateNNSearch(const Point3f& query, Point3f& point, float& squareDist, float epsilon,
+                                 int maxLeafVisits = 0) const;
+
+        /** @overload
+         * @brief Approximate nearest neighbor search for a batch of query points, in Morton order and in parallel
+         * like the batched KNNSearch().
+         * @param queries Query points.
+         * @param points Output, the point found for every query.
+         * @param squareDists Output, their squared distances, infinity if the tree is empty.
+         * @param epsilon See above.
+         * @param maxLeafVisits See above.
+         */
+        void approximateNNSearch(const std::vector<Point3f>& queries, std::vector<Point3f>& points,
+                                 std::vector<float>& squareDists, float epsilon, int maxLeafVisits = 0) const;
+
+        /** @brief Voxel grid downsampling on the cells of the tree.
+         * Output the centroid of the points of every non-empty node at the given depth, so each point of the output
+         * stands for the points of one cube of size size / 2^depth. These are the points of getLevelPoints(), in
+         * Morton order.
+         * @param downsampledPoints Output, the centroids.
+         * @param depth The depth of the cells, from 0 for the root node to maxDepth for the leaves. A negative depth
+         * or a depth above maxDepth selects the leaves.
+         */
+        void voxelDownsample(std::vector<Point3f>& downsampledPoints, int depth = -1) const;
+
+        /** @brief The level of a coarse-to-fine pyramid at a given depth, read from the tree itself.
+         * The level has one point per cell of the depth, the centroid of the points of the node at that depth, or of
+         * the leaf above it. The centroids come from getAggregate() and are computed in parallel, from the aggregates
+         * cached by updateAggregates() where they are up to date, so one tree serves every level of the pyramid
+         * without any rebuild. The tree is only read, see getAggregate().
+         * @param depth The depth of the level, from 0 for the root node to maxDepth for the leaves. A negative depth
+         * or a depth above maxDepth selects the leaves.
+         * @param points Output, the centroids of the cells, in Morton order.
+         * @param counts Output, the number of points of every cell, e.g. to weight the level in a registration.
+         */
+        void getLevelPoints(int depth, std::vector<Point3f>& points, std::vector<int>& counts) const;
+
+        /** @brief Radius search among the points of the level at a given depth, see getLevelPoints().
+         * The nodes are pruned by their cube like in radiusNNSearch() and the search stops at the depth of the level,
+         * where the centroid of the node stands for all its points.
+         * @param depth The depth of the level, see getLevelPoints().
+         * @param query Query point.
+         * @param radius Retrieved radius value.
+         * @param pointSet Point output. Contains the centroids found, sorted by distance in ascending order.
+         * @param squareDistSet Dist output. Contains the squared distance of the centroids.
+         * @return The number of centroids found.
+         */
+        int radiusNNSearchAtDepth(int depth, const Point3f& query, float radius, std::vector<Point3f>& pointSet,
+                                  std::vector<float>& squareDistSet) const;
+
+        /** @brief K nearest neighbor search among the points of the level at a given depth, see getLevelPoints().
+         * The nodes are visited closest first like in KNNSearch(), down to the depth of the level.
+         * @param depth The depth of the level, see getLevelPoints().
+         * @param query Query point.
+         * @param K The number of neighbors to search.
+         * @param pointSet Point output. Contains K centroids, sorted by distance in ascending order. Fewer if the
+         * level holds less than K cells.
+         * @param squareDistSet Dist output. Contains the squared distance of the K centroids.
+         */
+        void KNNSearchAtDepth(int depth, const Point3f& query, const int K, std::vector<Point3f>& pointSet,
+                              std::vector<float>& squareDistSet) const;
+
+        /** @brief Export the cubes of the nodes at a given depth as a single mesh.
+         * The nodes are selected and written in one traversal. Each cube adds its 8 corners to vertices, corner i
+         * being origin + size * (i & 1, (i >> 1) & 1, (i >> 2) & 1), and its primitives to indices, see OctreeMeshMode.
+         * The buffers can be handed over to viz::WMesh or to a GL vertex and index buffer as they are.
+         * @param depth The depth of the nodes, a negative depth or a depth above maxDepth selects the leaves.
+         * @param vertices Output, the corners of the cubes.
+         * @param indices Output, the indices of the primitives in vertices.
+         * @param mode See OctreeMeshMode.
+         */
+        void exportNodeBoxes(int depth, std::vector<Point3f>& vertices, std::vector<int>& indices,
+                             int mode = OCTREE_MESH_TRIANGLES) const;
+
+        /** @overload
+         * @brief Export the cubes of the nodes within a screen-space error budget.
+         * Nodes are refined while their cube, seen from the viewpoint, would cover more than maxScreenError pixels,
+         * so the cubes close to the viewpoint are small and the far ones coarse. The cubes containing the viewpoint
+         * are always refined down to the leaves.
+         * @param viewpoint The position of the camera.
+         * @param focalLength The focal length of the camera in pixels.
+         * @param maxScreenError The largest projected cube size in pixels.
+         * @param vertices Output, the corners of the cubes.
+         * @param indices Output, the indices of the primitives in vertices.
+         * @param mode See OctreeMeshMode.
+         */
+        void exportNodeBoxes(const Point3f& viewpoint, float focalLength, float maxScreenError,
+                             std::vector<Point3f>& vertices, std::vector<int>& indices,
+                             int mode = OCTREE_MESH_TRIANGLES) const;
+
+        /** @brief Find the first leaf crossed by a ray.
+         * The nodes are visited front to back with a parametric traversal: the ray is mirrored so that it goes
+         * towards positive coordinates, and the children of a node are walked in the order the ray crosses them.
+         * @param rayOrigin The origin of the ray, inside or outside the root cube.
+         * @param direction The direction of the ray, not necessarily normalized.
+         * @param distance Output, the distance from rayOrigin to the point where the ray enters the leaf cube,
+         * 0 if rayOrigin is in the leaf.
+         * @param maxDistance The length of the ray.
+         * @return The leaf, or NULL if the ray does not cross any leaf within maxDistance.
+         */
+        const OctreeNode* rayCast(const Point3f& rayOrigin, const Point3f& direction, float& distance,
+                                  float maxDistance = std::numeric_limits<float>::max()) const;
+
+        /** @overload
+         * @brief Cast a batch of rays on all the threads of cv::parallel_for_.
+         * @param rayOrigins The origins of the rays.
+         * @param directions The directions of the rays, one per origin.
+         * @param hits Output, the leaf hit by every ray, NULL for a miss.
+         * @param distances Output, the distance of every hit, infinity for a miss.
+         * @param maxDistance The length of the rays.
+         */
+        void rayCast(const std::vector<Point3f>& rayOrigins, const std::vector<Point3f>& directions,
+                     std::vector<const OctreeNode*>& hits, std::vector<float>& distances,
+                     float maxDistance = std::numeric_limits<float>::max()) const;
+
+        /** @brief Find the leaves whose cube intersects a convex volume, such as a camera frustum.
+         * A node outside one of the planes is skipped, and the planes a node is inside are not tested again for
+         * its children, so that the subtrees fully inside are collected without any test.
+         * @param planes Up to 32 planes (a, b, c, d), the inside being a*x + b*y + c*z + d >= 0.
+         * @param leaves Output, the leaves in depth-first order, which is the Morton order.
+         */
+        void frustumCull(const std::vector<Vec4f>& planes, std::vector<const OctreeNode*>& leaves) const;
+
+        /** @overload
+         * @brief Find the points of a compact tree in the leaves intersecting a convex volume, as ranges.
+         * The points of consecutive leaves are contiguous in getCompactPoints(), so a subtree inside the volume
+         * makes a single range with a built tree, suitable to draw a vertex buffer holding the points in leaf order.
+         * @param planes See frustumCull(const std::vector<Vec4f>&, std::vector<const OctreeNode*>&).
+         * @param pointRanges Output, the ranges of positions in getCompactPoints(), sorted and disjoint.
+         */
+        void frustumCull(const std::vector<Vec4f>& planes, std::vector<Range>& pointRanges) const;
+
+        /** @overload
+         * @brief Cull the tree against a batch of volumes, for example the cameras of a rig, on all the threads
+         * of cv::parallel_for_.
+         * @param frustums The planes of every volume.
+         * @param leaves Output, the leaves of every volume.
+         */
+        void frustumCull(const std::vector<std::vector<Vec4f> >& frustums,
+                         std::vector<std::vector<const OctreeNode*> >& leaves) const;
+
+        /** @brief Find the leaves that differ between this tree and other, for example the next scan of a scene.
+         * The two trees are walked together from the root nodes, and the subtrees holding the same points are
+         * skipped: their nodes are the same, as in the snapshots of a ConcurrentOctree, or their hashes are equal,
+         * see getNodeHash(). Once the hashes of the trees are cached by updateHashes(), the walk only follows the paths
+         * that changed.
+         * Where one tree has a leaf and the other an intermediate node, as with different leaf capacities, the leaf
+         * is reported as removed or added, and the leaves below the intermediate node the other way round.
+         * The trees are only read, see getNodeHash().
+         * @param other The tree to compare with, with the same root cube and maxDepth.
+         * @param addedLeaves Output, the leaves of other where this tree has no leaf.
+         * @param removedLeaves Output, the leaves of this tree where other has no leaf.
+         * @param changedLeaves Output, the leaves of this tree and of other with the same cube and different points.
+         */
+        void diff(const Octree& other, std::vector<const OctreeNode*>& addedLeaves,
+                  std::vector<const OctreeNode*>& removedLeaves,
+                  std::vector<std::pair<const OctreeNode*, const OctreeNode*> >& changedLeaves) const;
+
+        /** @brief The hash of the points below a node of the tree, whatever the order they were inserted in.
+         * Two nodes holding the same points have the same hash, in any tree. The hash cached by updateHashes() is
+         * returned while no insertion or deletion went through the node, otherwise the hash is computed from the
+         * hashes of the children without being stored. The tree is only read, so the hashes of a tree, or of the
+         * snapshots of a ConcurrentOctree sharing its nodes, can be taken on several threads.
+         */
+        uint64 getNodeHash(const OctreeNode* node) const;
+
+        /** @brief Compute and cache the hash of every node whose hash is out of date, see getNodeHash().
+         * The nodes on the paths of the insertions and deletions since the previous call are hashed again from their
+         * children, the other ones are kept.
+         */
+        void updateHashes();
+
+        /** @brief The count, sum, sum of outer products and attribute sums of the points below a node of the tree.
+         * The aggregate cached by updateAggregates() is returned while it is up to date, otherwise the aggregate is
+         * computed without being stored, a leaf from its points and an intermediate node from its children. The
+         * tree is only read, so the aggregates of a tree, or of the snapshots of a ConcurrentOctree sharing its
+         * nodes, can be taken on several threads.
+         * @param node A node of the tree.
+         * @return The aggregate.
+         */
+        OctreeAggregate getAggregate(const OctreeNode* node) const;
+
+        /** @brief Compute and cache the aggregate of every node whose aggregate is out of date, see getAggregate().
+         * Insertions and deletions then update the cached aggregate of their leaf and only mark its ancestors, which
+         * the next call sums again from their children, so the points are never gone through again. A tree that is
+         * never asked to cache its aggregates does not pay for them.
+         */
+        void updateAggregates();
+
+        /** @brief Set the attributes summed by getAggregate(), such as the confidence or intensity of PLYReader.
+         * The attributes of a point of a compact tree are found from its index in the source point cloud, and the
+         * ones of a point of another tree from its position in pointCloud. The points found in neither have zero
+         * attributes. The cached aggregates are dropped.
+         * @param pointCloud The point cloud the leaves point to, unused for a compact tree.
+         * @param attributes attributeNum values per point, in the order of the point cloud. They must outlive the tree.
+         * @param pointNum The number of points in the point cloud.
+         * @param attributeNum The number of attributes of a point, 0 for none.
+         */
+        void setAggregateAttributes(const Point3f* pointCloud, const float* attributes, size_t pointNum,
+                                    int attributeNum);
+
+        /** @brief Precompute the neighbor leaves of every leaf, for getLeafNeighbors().
+         * The neighbors of a leaf are found from its cell coordinates: the cell next to it in every direction is
+         * located from the root node, and is either part of a leaf as large or larger, or holds smaller leaves, of
+         * which the ones touching the leaf are kept. The leaves are processed in parallel. The table is dropped by
+         * the next modification of the tree.
+         * @param connectivity 6 for the leaves sharing a face, 18 for a face or an edge, 26 for a face, an edge or
+         * a corner.
+         */
+        void buildLeafAdjacency(int connectivity = 6);
+
+        /** @brief The neighbor leaves of a leaf, read from the table of buildLeafAdjacency().
+         * @param leaf A leaf of the tree.
+         * @param neighbors Output, the neighbors of leaf.
+         * @return false if the table is not built or leaf is not a leaf of the tree.
+         */
+        bool getLeafNeighbors(const OctreeNode* leaf, std::vector<const OctreeNode*>& neighbors) const;
+
         //! The pointer to Octree root node.
         OctreeNode* rootNode = nullptr;
 
@@ -271,22 +991,304 @@ namespace cv {
 
     private:
 
+        //! Owns all the OctreeNodes of the tree. NULL in a tree that was moved from, until it creates nodes again.
+        Ptr<OctreeNodePool> nodePool;
+
+        //! The pool of the nodes, created if the tree was moved from.
+        OctreeNodePool& getNodePool();
+
+        /** @brief Compute the Morton code of a point inside the root cube at maxDepth resolution.
+         * The 3 bits of each level are ordered like the children, x + 2y + 4z, and the first level
+         * takes the most significant bits. Every insertion and lookup selects children from this code.
+         */
+        uint64 mortonCode(const Point3f& point) const;
+
+        /** @brief Build the tree from the points inside the root cube.
+         * @param points Point cloud data. Only the compact build accepts points that must not be written to,
+         * the other builds store pointers to them.
+         */
+        void buildTree(Point3f* points, size_t pointNum, int flags);
+
+        /** @brief Build the tree from the point cloud through sorted Morton codes, see OCTREE_BUILD_MORTON.
+         * @param onDevice Sort the codes on the OpenCL device if there is one, see OCTREE_BUILD_OPENCL.
+         */
+        void buildFromMortonCodes(Point3f* points, size_t pointNum, bool onDevice = false);
+
+        //! The multi-threaded version of buildFromMortonCodes, see OCTREE_BUILD_PARALLEL.
+        void buildFromMortonCodesParallel(Point3f* points, size_t pointNum);
+
+        /** @brief Create the nodes below subRoot for a run of points sorted by Morton code.
+         * All the keys must share the prefix of subRoot.
+         * @param subRoot The node the points fall in.
+         * @param keys The sorted Morton codes.
+         * @param indices The indices of the points, in key order.
+         * @param pointNum The number of points in the run.
+         * @param points Point cloud data.
+         * @param firstPosition The position of the run in the whole sorted point cloud.
+         * @param pool The pool providing the new nodes.
+         */
+        void emitMortonSubtree(OctreeNode* subRoot, const uint64* keys, const int* indices, size_t pointNum,
+                               Point3f* points, int firstPosition, OctreeNodePool& pool) const;
+
+        /** @brief The emitMortonSubtree of leaf capacity mode, see setLeafCapacity().
+         * The run is split by the child index at the next level for as long as it holds more than leafCapacity points.
+         */
+        void emitBucketSubtree(OctreeNode* subRoot, const uint64* keys, const int* indices, size_t pointNum,
+                               Point3f* points, int firstPosition, OctreeNodePool& pool) const;
+
+        //! The number of points of a leaf node, in both storage modes.
+        size_t leafPointCount(const OctreeNode* leaf) const;
+
+        //! The i-th point of a leaf node, in both storage modes.
+        const Point3f* leafPoint(const OctreeNode* leaf, size_t i) const;
+
+        //! The position of point in the leaf node, or -1 if the leaf does not contain it.
+        int findPointInLeaf(const OctreeNode* leaf, const Point3f& point) const;
+
+        //! If the tree was built with OCTREE_BUILD_COMPACT.
+        bool compact = false;
+
+        //! See setAutoExpand().
+        bool autoExpand = false;
+
+        //! See setBoundPadding().
+        float boundPadding = 0;
+
+        //! See setLeafCapacity().
+        size_t leafCapacity = 0;
+
+        //! Fit the root cube to the bounding box of a point cloud, see setBoundPadding().
+        void setRootCube(const Point3f& minBound, const Point3f& maxBound);
+
+        /** @brief Grow the root cube until it contains the box [low, high], the old root becomes a child of the new one.
+         * The nodes are renumbered, and the points that the new Morton codes place in another leaf are moved there.
+         */
+        void expandRoot(const Point3f& low, const Point3f& high);
+
+        //! Compact trees only. The points in leaf order, unless they are memory mapped.
+        std::vector<Point3f> compactPoints;
+
+        //! Compact trees only. The indices in the source point cloud of compactPoints, unless they are memory mapped.
+        std::vector<int> compactIndices;
+
+        //! Compact trees only. The points in leaf order, in compactPoints or in the mapped file.
+        const Point3f* compactPointData = nullptr;
+
+        //! Compact trees only. The indices of the points of compactPointData, in compactIndices or in the mapped file.
+        const int* compactIndexData = nullptr;
+
+        //! The file of a tree loaded with load(path, true).
+        Ptr<MappedFile> mappedFile;
+
+        //! Drop the points of a compact tree.
+        void releaseCompactPoints();
+
+        /** @brief See buildLeafAdjacency(). The neighbors of the leaf of index i in leafIndices are stored in
+         * adjacentLeaves from adjacencyOffsets[i] to adjacencyOffsets[i + 1].
+         */
+        std::unordered_map<const OctreeNode*, int> leafIndices;
+        std::vector<int> adjacencyOffsets;
+        std::vector<const OctreeNode*> adjacentLeaves;
+
+        //! Drop the table of buildLeafAdjacency().
+        void releaseLeafAdjacency();
+
+        //! Copy the subtree of src below node, the children of node are expected to be NULL.
+        void copyNodeRecurse(const OctreeNode* src, OctreeNode* node);
+
         /** @brief Insert node recursively.
          * If the OctreeNode to be inserted does not exist, a new OctreeNode is created. If it exists,
          * add the point information to the pointList of the corresponding leaf node.
+         * The child at each level is read from the Morton code of the point.
          * @param node
          * @param point
+         * @param key The Morton code of point.
+         */
+        void insertPointRecurse( OctreeNode*& node, Point3f& point, uint64 key);
+
+        /** @brief The insertPointRecurse of leaf capacity mode, see setLeafCapacity().
+         * The point goes to the leaf on its path, or to a new leaf where the path stops, which is then split if
+         * it overflows.
+         */
+        void insertPointInBucket(OctreeNode* node, Point3f& point, uint64 key);
+
+        //! Hand the points of a leaf over to new children while it holds more than leafCapacity points.
+        void splitLeaf(OctreeNode* leaf);
+
+        //! Create the child childIndex of node from pool.
+        OctreeNode* createChild(OctreeNode* node, int childIndex, OctreeNodePool& pool) const;
+
+        //! Remove the i-th point of a leaf node, the last point of the leaf takes its place.
+        void removeLeafPoint(OctreeNode* leaf, size_t i);
+
+        //! Reset the cached hashes of node and of its ancestors, and the cached aggregates of its ancestors.
+        static void invalidateCaches(OctreeNode* node);
+
+        //! Update the caches for the point just appended to a leaf, see updateHashes() and updateAggregates().
+        void leafPointInserted(OctreeNode* leaf);
+
+        //! The attributes of the i-th point of a leaf node, NULL if it has none, see setAggregateAttributes().
+        const float* leafPointAttributes(const OctreeNode* leaf, size_t i) const;
+
+        //! Mark the cached aggregates of the subtree of node as out of date.
+        static void invalidateAggregates(OctreeNode* node);
+
+        //! See updateAggregates(), returns the cached aggregate of node.
+        const OctreeAggregate& updateAggregate(OctreeNode* node);
+
+        //! See updateHashes(), returns the cached hash of node.
+        uint64 updateHash(OctreeNode* node);
+
+        //! See setAggregateAttributes().
+        const Point3f* attributeCloud = nullptr;
+        const float* attributeData = nullptr;
+        size_t attributePointNum = 0;
+        int attributeNum = 0;
+
+        //! Compare the subtrees of node and otherNode, at the same place in this tree and in other, see diff().
+        void diffRecurse(const Octree& other, const OctreeNode* node, const OctreeNode* otherNode,
+                         std::vector<const OctreeNode*>& addedLeaves, std::vector<const OctreeNode*>& removedLeaves,
+                         std::vector<std::pair<const OctreeNode*, const OctreeNode*> >& changedLeaves) const;
+
+        /** @brief Delete node if it is an empty leaf or has no children, then its ancestors left without children.
+         * Deleting the root node leaves an empty tree.
+         */
+        void pruneEmptyNode(OctreeNode* node);
+
+        //! Append the cube of node to the mesh buffers, see exportNodeBoxes().
+        static void appendNodeBox(const OctreeNode* node, int mode, std::vector<Point3f>& vertices,
+                                  std::vector<int>& indices);
+
+        //! Get the order that sorts the points by Morton code.
+        void sortByMortonCode(const std::vector<Point3f>& points, std::vector<int>& order) const;
+
+        /** @brief The K nearest neighbors search of a single query.
+         * @param nodeHeap, best Scratch heaps, reused across calls.
+         * @param points, squareDists Output arrays of K elements.
+         * @return The number of neighbors found.
          */
-        void insertPointRecurse( OctreeNode*& node, Point3f& point);
+        int KNNSearchImpl(const Point3f& query, int K, std::vector<std::pair<float, const OctreeNode*> >& nodeHeap,
+                          std::vector<std::pair<float, const Point3f*> >& best, Point3f* points, float* squareDists) const;
 
-        /** @brief Delete a node from tree.
-         * Used to delete the node. If its parent node may also be deleted if its last child is deleted.
-         * @param node OctreeNode to be deleted.
-         * @return return ture if the deletion is completed.
+        /** @brief The approximate nearest neighbor search of a single query, see approximateNNSearch().
+         * @param nodeHeap Scratch heap, reused across calls.
+         * @param squareBound (1 + epsilon)^2.
+         * @return false if there is no point.
          */
-        bool deletePointRecurse( OctreeNode*& node);
+        bool approximateNNSearchImpl(const Point3f& query, float squareBound, int maxLeafVisits,
+                                     std::vector<std::pair<float, const OctreeNode*> >& nodeHeap, Point3f& nearest,
+                                     float& nearestSquareDist) const;
+
+        //! Collect the points of the subtree of node within sqrt(squareRadius) of query.
+        void radiusNNSearchRecurse(const OctreeNode* node, const Point3f& query, float squareRadius,
+                                   std::vector<std::pair<float, const Point3f*> >& candidates) const;
+
+        //! Collect the centroids of the level at depth in the subtree of node within sqrt(squareRadius) of query.
+        void radiusNNSearchAtDepthRecurse(const OctreeNode* node, int depth, const Point3f& query, float squareRadius,
+                                          std::vector<std::pair<float, Point3f> >& candidates) const;
 
     };
+
+    template<typename Predicate>
+    size_t Octree::removeIf(Predicate&& predicate)
+    {
+        std::vector<OctreeNode*> leaves;
+        traverseDFS(rootNode, [&leaves](OctreeNode* node)
+        {
+            if(node->isLeaf)
+                leaves.push_back(node);
+            return OCTREE_TRAVERSAL_CONTINUE;
+        });
+
+        size_t deleted = 0;
+        for(OctreeNode* leaf : leaves)
+        {
+            for(size_t i = 0; i < leafPointCount(leaf); )
+            {
+                if(predicate(*leafPoint(leaf, i)))
+                {
+                    removeLeafPoint(leaf, i);
+                    deleted++;
+                }
+                else
+                {
+                    i++;
+                }
+            }
+        }
+        for(OctreeNode* leaf : leaves)
+        {
+            if(leafPointCount(leaf) == 0)
+                pruneEmptyNode(leaf);
+        }
+        return deleted;
+    }
+
+    template<typename Visitor>
+    void Octree::traverseBFS(OctreeNode* node, Visitor&& visitor) const
+    {
+        if(node == nullptr)
+        {
+            return;
+        }
+
+        std::deque<OctreeNode*> queue(1, node);
+        while(!queue.empty())
+        {
+            OctreeNode* current = queue.front();
+            queue.pop_front();
+
+            int result = visitor(current);
+            if(result == OCTREE_TRAVERSAL_STOP)
+            {
+                return;
+            }
+            if(result == OCTREE_TRAVERSAL_SKIP_CHILDREN || current->isLeaf)
+            {
+                continue;
+            }
+            for(int childIndex = 0; childIndex < childNum; childIndex++)
+            {
+                if(current->children[childIndex] != nullptr)
+                    queue.push_back(current->children[childIndex]);
+            }
+        }
+    }
+
+    template<typename Visitor>
+    void Octree::traverseDFS(OctreeNode* node, Visitor&& visitor) const
+    {
+        if(node == nullptr)
+        {
+            return;
+        }
+
+        // At most 7 pending siblings per level, plus the node being expanded.
+        std::vector<OctreeNode*> stack;
+        stack.reserve((size_t)std::max(maxDepth, 0) * (childNum - 1) + childNum);
+        stack.push_back(node);
+        while(!stack.empty())
+        {
+            OctreeNode* current = stack.back();
+            stack.pop_back();
+
+            int result = visitor(current);
+            if(result == OCTREE_TRAVERSAL_STOP)
+            {
+                return;
+            }
+            if(result == OCTREE_TRAVERSAL_SKIP_CHILDREN || current->isLeaf)
+            {
+                continue;
+            }
+            // Pushed in reverse, so that the first child is popped first.
+            for(int childIndex = childNum - 1; childIndex >= 0; childIndex--)
+            {
+                if(current->children[childIndex] != nullptr)
+                    stack.push_back(current->children[childIndex]);
+            }
+        }
+    }
 //! @} 3d
 }
 
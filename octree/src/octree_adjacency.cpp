@@ -0,0 +1,197 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <algorithm>
+#include "octree.h"
+
+namespace cv{
+
+    //! A leaf with the integer coordinates of its cell at its depth.
+    struct LeafCell
+    {
+        const OctreeNode* leaf;
+        int x, y, z;
+    };
+
+    /** @brief Append the leaves of the subtree of node that touch the cell it is the neighbor of.
+     * On every axis, the direction d from the cell to node keeps the children on the side facing the cell: the lower
+     * half for d = 1, the upper half for d = -1, both for d = 0.
+     */
+    static void collectFacingLeaves(const OctreeNode* node, const int* direction,
+                                    std::vector<const OctreeNode*>& leaves)
+    {
+        if(node->isLeaf)
+        {
+            leaves.push_back(node);
+            return;
+        }
+        for(int childIndex = 0; childIndex < OctreeNode::childNum; childIndex++)
+        {
+            const OctreeNode* child = node->children[childIndex];
+            bool facing = true;
+            for(int axis = 0; axis < 3 && facing; axis++)
+            {
+                int upper = (childIndex >> axis) & 1;
+                facing = direction[axis] == 0 || (direction[axis] > 0 ? upper == 0 : upper == 1);
+            }
+            if(child != nullptr && facing)
+            {
+                collectFacingLeaves(child, direction, leaves);
+            }
+        }
+    }
+
+    void Octree::releaseLeafAdjacency()
+    {
+        if(!leafIndices.empty())
+        {
+            leafIndices.clear();
+            std::vector<int>().swap(adjacencyOffsets);
+            std::vector<const OctreeNode*>().swap(adjacentLeaves);
+        }
+    }
+
+    void Octree::buildLeafAdjacency(int connectivity)
+    {
+        CV_Assert(connectivity == 6 || connectivity == 18 || connectivity == 26);
+        releaseLeafAdjacency();
+        if(rootNode == nullptr)
+        {
+            return;
+        }
+
+        // The directions sharing a face, then an edge, then a corner, up to the connectivity.
+        std::vector<Vec3i> directions;
+        for(int axisNum = 1; axisNum <= 3; axisNum++)
+        {
+            for(int dz = -1; dz <= 1; dz++)
+            {
+                for(int dy = -1; dy <= 1; dy++)
+                {
+                    for(int dx = -1; dx <= 1; dx++)
+                    {
+                        if((dx != 0) + (dy != 0) + (dz != 0) == axisNum)
+                        {
+                            directions.push_back(Vec3i(dx, dy, dz));
+                        }
+                    }
+                }
+            }
+            if((int)directions.size() == connectivity)
+            {
+                break;
+            }
+        }
+
+        // The leaves in depth-first order, with their cells.
+        std::vector<LeafCell> cells;
+        std::vector<LeafCell> stack(1, LeafCell{rootNode, 0, 0, 0});
+        while(!stack.empty())
+        {
+            LeafCell cell = stack.back();
+            stack.pop_back();
+            if(cell.leaf->isLeaf)
+            {
+                cells.push_back(cell);
+                continue;
+            }
+            for(int childIndex = childNum - 1; childIndex >= 0; childIndex--)
+            {
+                const OctreeNode* child = cell.leaf->children[childIndex];
+                if(child != nullptr)
+                {
+                    stack.push_back(LeafCell{child, 2 * cell.x + (childIndex & 1), 2 * cell.y + ((childIndex >> 1) & 1),
+                                             2 * cell.z + ((childIndex >> 2) & 1)});
+                }
+            }
+        }
+        const int leafNum = (int)cells.size();
+        leafIndices.reserve(leafNum);
+        for(int i = 0; i < leafNum; i++)
+        {
+            leafIndices[cells[i].leaf] = i;
+        }
+
+        // Every chunk writes the neighbors of its leaves in its own buffer, and the buffers are joined in order.
+        const int chunkNum = std::min(std::max(cv::getNumThreads(), 1) * 4, leafNum);
+        std::vector<std::vector<const OctreeNode*> > chunkNeighbors(chunkNum);
+        std::vector<int> neighborCounts(leafNum);
+        parallel_for_(Range(0, chunkNum), [&](const Range& range)
+        {
+            for(int chunk = range.start; chunk < range.end; chunk++)
+            {
+                std::vector<const OctreeNode*>& neighbors = chunkNeighbors[chunk];
+                int first = (int)((int64)leafNum * chunk / chunkNum);
+                int last = (int)((int64)leafNum * (chunk + 1) / chunkNum);
+                for(int i = first; i < last; i++)
+                {
+                    const LeafCell& cell = cells[i];
+                    const int depth = cell.leaf->depth;
+                    const int cellNum = 1 << depth;
+                    const size_t start = neighbors.size();
+                    for(const Vec3i& direction : directions)
+                    {
+                        const int nx = cell.x + direction[0], ny = cell.y + direction[1], nz = cell.z + direction[2];
+                        if(nx < 0 || ny < 0 || nz < 0 || nx >= cellNum || ny >= cellNum || nz >= cellNum)
+                        {
+                            continue;
+                        }
+
+                        // Walk down to the neighbor cell, a leaf on the way covers it.
+                        const OctreeNode* node = rootNode;
+                        for(int level = depth - 1; level >= 0 && node != nullptr && !node->isLeaf; level--)
+                        {
+                            node = node->children[((nx >> level) & 1) | (((ny >> level) & 1) << 1) |
+                                                  (((nz >> level) & 1) << 2)];
+                        }
+                        if(node == nullptr)
+                        {
+                            continue;
+                        }
+                        const size_t found = neighbors.size();
+                        collectFacingLeaves(node, direction.val, neighbors);
+
+                        // A larger leaf is met again through the other directions leading to it.
+                        size_t kept = found;
+                        for(size_t j = found; j < neighbors.size(); j++)
+                        {
+                            if(std::find(neighbors.begin() + start, neighbors.begin() + found, neighbors[j]) ==
+                               neighbors.begin() + found)
+                            {
+                                neighbors[kept++] = neighbors[j];
+                            }
+                        }
+                        neighbors.resize(kept);
+                    }
+                    neighborCounts[i] = (int)(neighbors.size() - start);
+                }
+            }
+        });
+
+        adjacencyOffsets.resize(leafNum + 1);
+        adjacencyOffsets[0] = 0;
+        for(int i = 0; i < leafNum; i++)
+        {
+            adjacencyOffsets[i + 1] = adjacencyOffsets[i] + neighborCounts[i];
+        }
+        adjacentLeaves.reserve(adjacencyOffsets[leafNum]);
+        for(int chunk = 0; chunk < chunkNum; chunk++)
+        {
+            adjacentLeaves.insert(adjacentLeaves.end(), chunkNeighbors[chunk].begin(), chunkNeighbors[chunk].end());
+        }
+    }
+
+    bool Octree::getLeafNeighbors(const OctreeNode* leaf, std::vector<const OctreeNode*>& neighbors) const
+    {
+        neighbors.clear();
+        auto it = leafIndices.find(leaf);
+        if(it == leafIndices.end())
+        {
+            return false;
+        }
+        neighbors.assign(adjacentLeaves.begin() + adjacencyOffsets[it->second],
+                         adjacentLeaves.begin() + adjacencyOffsets[it->second + 1]);
+        return true;
+    }
+}
@@ -0,0 +1,221 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <cstdint>
+#include "octree.h"
+
+namespace cv{
+
+    void OctreeAggregate::reset(const Point3f& _reference, int attributeNum)
+    {
+        count = 0;
+        reference = _reference;
+        sum = Vec3d();
+        sumOuter = Matx33d();
+        attributeSums.assign(attributeNum, 0.0);
+    }
+
+    void OctreeAggregate::accumulate(const Point3f& point, const float* attributes, int weight)
+    {
+        const double d[3] = {(double)point.x - reference.x, (double)point.y - reference.y,
+                             (double)point.z - reference.z};
+        count += weight;
+        for(int i = 0; i < 3; i++)
+        {
+            sum[i] += weight * d[i];
+            for(int j = 0; j < 3; j++)
+            {
+                sumOuter(i, j) += weight * d[i] * d[j];
+            }
+        }
+        if(attributes != nullptr)
+        {
+            for(size_t i = 0; i < attributeSums.size(); i++)
+            {
+                attributeSums[i] += weight * (double)attributes[i];
+            }
+        }
+    }
+
+    void OctreeAggregate::merge(const OctreeAggregate& other)
+    {
+        // Move the sums of other to our reference: p - reference = (p - other.reference) + shift.
+        const double shift[3] = {(double)other.reference.x - reference.x, (double)other.reference.y - reference.y,
+                                 (double)other.reference.z - reference.z};
+        const double n = (double)other.count;
+        for(int i = 0; i < 3; i++)
+        {
+            for(int j = 0; j < 3; j++)
+            {
+                sumOuter(i, j) += other.sumOuter(i, j) + shift[i] * other.sum[j] + other.sum[i] * shift[j] +
+                                  n * shift[i] * shift[j];
+            }
+        }
+        for(int i = 0; i < 3; i++)
+        {
+            sum[i] += other.sum[i] + n * shift[i];
+        }
+        count += other.count;
+        for(size_t i = 0; i < attributeSums.size(); i++)
+        {
+            attributeSums[i] += other.attributeSums[i];
+        }
+    }
+
+    Point3f OctreeAggregate::getCentroid() const
+    {
+        if(count == 0)
+        {
+            return reference;
+        }
+        return Point3f((float)(reference.x + sum[0] / count), (float)(reference.y + sum[1] / count),
+                       (float)(reference.z + sum[2] / count));
+    }
+
+    Matx33d OctreeAggregate::getCovariance() const
+    {
+        Matx33d covariance;
+        if(count == 0)
+        {
+            return covariance;
+        }
+        const double mean[3] = {sum[0] / count, sum[1] / count, sum[2] / count};
+        for(int i = 0; i < 3; i++)
+        {
+            for(int j = 0; j < 3; j++)
+            {
+                covariance(i, j) = sumOuter(i, j) / count - mean[i] * mean[j];
+            }
+        }
+        return covariance;
+    }
+
+    double OctreeAggregate::getAttributeMean(int attribute) const
+    {
+        CV_Assert(attribute >= 0 && attribute < (int)attributeSums.size());
+        return count == 0 ? 0.0 : attributeSums[attribute] / count;
+    }
+
+    const float* Octree::leafPointAttributes(const OctreeNode* leaf, size_t i) const
+    {
+        if(attributeNum == 0)
+        {
+            return nullptr;
+        }
+
+        size_t index;
+        if(compact)
+        {
+            index = (size_t)compactIndexData[leaf->pointOffset + i];
+        }
+        else
+        {
+            // Compare the addresses as integers, the point may belong to another array.
+            uintptr_t address = (uintptr_t)leaf->pointList[i], first = (uintptr_t)attributeCloud;
+            if(attributeCloud == nullptr || address < first)
+            {
+                return nullptr;
+            }
+            index = (address - first) / sizeof(Point3f);
+        }
+        return index < attributePointNum ? attributeData + index * attributeNum : nullptr;
+    }
+
+    void Octree::invalidateAggregates(OctreeNode* node)
+    {
+        if(node->aggregate)
+        {
+            node->aggregate->valid = false;
+        }
+        for(OctreeNode* child : node->children)
+        {
+            if(child != nullptr)
+            {
+                invalidateAggregates(child);
+            }
+        }
+    }
+
+    void Octree::setAggregateAttributes(const Point3f* pointCloud, const float* attributes, size_t pointNum,
+                                        int _attributeNum)
+    {
+        CV_Assert(_attributeNum >= 0 && (attributes != nullptr || _attributeNum == 0 || pointNum == 0));
+        attributeCloud = pointCloud;
+        attributeData = attributes;
+        attributePointNum = pointNum;
+        attributeNum = _attributeNum;
+        if(rootNode != nullptr)
+        {
+            invalidateAggregates(rootNode);
+        }
+    }
+
+    OctreeAggregate Octree::getAggregate(const OctreeNode* node) const
+    {
+        if(node->aggregate && node->aggregate->valid)
+        {
+            return *node->aggregate;
+        }
+
+        OctreeAggregate aggregate;
+        aggregate.reset(node->origin, attributeNum);
+        if(node->isLeaf)
+        {
+            const size_t pointNum = leafPointCount(node);
+            for(size_t i = 0; i < pointNum; i++)
+            {
+                aggregate.accumulate(*leafPoint(node, i), leafPointAttributes(node, i), 1);
+            }
+        }
+        else
+        {
+            for(const OctreeNode* child : node->children)
+            {
+                if(child != nullptr)
+                {
+                    aggregate.merge(getAggregate(child));
+                }
+            }
+        }
+        aggregate.valid = true;
+        return aggregate;
+    }
+
+    const OctreeAggregate& Octree::updateAggregate(OctreeNode* node)
+    {
+        if(!node->aggregate)
+        {
+            node->aggregate.reset(new OctreeAggregate());
+        }
+        OctreeAggregate& aggregate = *node->aggregate;
+        if(aggregate.valid)
+        {
+            return aggregate;
+        }
+
+        if(node->isLeaf)
+        {
+            aggregate = getAggregate(node);
+            return aggregate;
+        }
+        aggregate.reset(node->origin, attributeNum);
+        for(OctreeNode* child : node->children)
+        {
+            if(child != nullptr)
+            {
+                aggregate.merge(updateAggregate(child));
+            }
+        }
+        aggregate.valid = true;
+        return aggregate;
+    }
+
+    void Octree::updateAggregates()
+    {
+        if(rootNode != nullptr)
+        {
+            updateAggregate(rootNode);
+        }
+    }
+}
@@ -0,0 +1,543 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "octree.h"
+#include "morton.h"
+#include "opencv2/core.hpp"
+
+namespace cv{
+
+    static const char OCTREE_CODEC_MAGIC[8] = {'C', 'V', 'O', 'C', 'T', 'O', 'C', 'C'};
+    static const uint32_t OCTREE_CODEC_VERSION = 1;
+    static const int OCTREE_CODEC_MAX_RESIDUAL_BITS = 16;
+
+    /** @brief The header of an encoded Octree.
+     * It is followed by the structure section, the occupancy bytes then the point counts, range coded or as is,
+     * and by the residual section, the bit packed points.
+     */
+    struct OctreeCodecHeader
+    {
+        char magic[8];
+        uint32_t version;
+        int32_t maxDepth;
+        double size;
+        float origin[3];
+        //! Written as 1, reads differently on a machine with the other byte order.
+        uint32_t byteOrder;
+        uint8_t residualBits;
+        uint8_t entropyCoded;
+        uint16_t reserved;
+        //! The number of occupancy bytes, one per node above maxDepth.
+        uint64_t nodeNum;
+        uint64_t leafNum;
+        uint64_t pointNum;
+        uint64_t structureSize;
+        uint64_t residualSize;
+    };
+
+    //! The probabilities of the range coder are 11 bits fixed point, adapted by 1/32 of the error at every bit.
+    static const int RANGE_PROB_BITS = 11;
+    static const int RANGE_MOVE_BITS = 5;
+    static const uint32_t RANGE_TOP = 1u << 24;
+
+    //! An adaptive model of bytes, coded bit by bit from the most significant one, each with its own probability.
+    struct RangeByteModel
+    {
+        RangeByteModel()
+        {
+            std::fill(probs, probs + 256, (uint16_t)(1 << (RANGE_PROB_BITS - 1)));
+        }
+        uint16_t probs[256];
+    };
+
+    //! Binary range encoder, with the carry propagation of LZMA.
+    class RangeEncoder
+    {
+    public:
+        explicit RangeEncoder(std::vector<uchar>& _out):out(_out), low(0), range(0xFFFFFFFFu), cache(0), cacheSize(1)
+        {
+        }
+
+        void encodeBit(uint16_t& prob, int bit)
+        {
+            uint32_t bound = (range >> RANGE_PROB_BITS) * prob;
+            if(bit == 0)
+            {
+                range = bound;
+                prob += ((1 << RANGE_PROB_BITS) - prob) >> RANGE_MOVE_BITS;
+            }
+            else
+            {
+                low += bound;
+                range -= bound;
+                prob -= prob >> RANGE_MOVE_BITS;
+            }
+            while(range < RANGE_TOP)
+            {
+                range <<= 8;
+                shiftLow();
+            }
+        }
+
+        void encodeByte(RangeByteModel& model, uchar value)
+        {
+            int m = 1;
+            for(int i = 7; i >= 0; i--)
+            {
+                int bit = (value >> i) & 1;
+                encodeBit(model.probs[m], bit);
+                m = (m << 1) | bit;
+            }
+        }
+
+        void flush()
+        {
+            for(int i = 0; i < 5; i++)
+            {
+                shiftLow();
+            }
+        }
+
+    private:
+        void shiftLow()
+        {
+            if((uint32_t)low < 0xFF000000u || (low >> 32) != 0)
+            {
+                uchar carry = (uchar)(low >> 32);
+                uchar pending = cache;
+                do
+                {
+                    out.push_back((uchar)(pending + carry));
+                    pending = 0xFF;
+                } while(--cacheSize != 0);
+                cache = (uchar)(low >> 24);
+            }
+            cacheSize++;
+            low = (low & 0x00FFFFFFu) << 8;
+        }
+
+        std::vector<uchar>& out;
+        uint64_t low;
+        uint32_t range;
+        uchar cache;
+        uint64_t cacheSize;
+    };
+
+    //! The decoder of RangeEncoder. Reading past the end yields zeros and sets overrun.
+    class RangeDecoder
+    {
+    public:
+        RangeDecoder(const uchar* _data, size_t _dataSize):overrun(false), data(_data), dataSize(_dataSize),
+                position(0), range(0xFFFFFFFFu), code(0)
+        {
+            for(int i = 0; i < 5; i++)
+            {
+                code = (code << 8) | nextByte();
+            }
+        }
+
+        int decodeBit(uint16_t& prob)
+        {
+            uint32_t bound = (range >> RANGE_PROB_BITS) * prob;
+            int bit;
+            if(code < bound)
+            {
+                range = bound;
+                prob += ((1 << RANGE_PROB_BITS) - prob) >> RANGE_MOVE_BITS;
+                bit = 0;
+            }
+            else
+            {
+                code -= bound;
+                range -= bound;
+                prob -= prob >> RANGE_MOVE_BITS;
+                bit = 1;
+            }
+            while(range < RANGE_TOP)
+            {
+                range <<= 8;
+                code = (code << 8) | nextByte();
+            }
+            return bit;
+        }
+
+        uchar decodeByte(RangeByteModel& model)
+        {
+            int m = 1;
+            for(int i = 0; i < 8; i++)
+            {
+                m = (m << 1) | decodeBit(model.probs[m]);
+            }
+            return (uchar)(m & 0xFF);
+        }
+
+        bool overrun;
+
+    private:
+        uchar nextByte()
+        {
+            if(position < dataSize)
+            {
+                return data[position++];
+            }
+            overrun = true;
+            return 0;
+        }
+
+        const uchar* data;
+        size_t dataSize;
+        size_t position;
+        uint32_t range;
+        uint32_t code;
+    };
+
+    static int popCount8(uchar value)
+    {
+        int count = 0;
+        for(; value != 0; value &= (uchar)(value - 1))
+        {
+            count++;
+        }
+        return count;
+    }
+
+    //! Split a point count in bytes of 7 bits, the lowest first, all but the last with the high bit set.
+    static void appendVarint(std::vector<uchar>& out, uint64_t value)
+    {
+        while(value >= 0x80)
+        {
+            out.push_back((uchar)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((uchar)value);
+    }
+
+    //! The quantized coordinate of value within [low, low + extent), clamped to the cells.
+    static uint32_t quantize(float value, float low, float extent, int bits)
+    {
+        const float cells = (float)(1u << bits);
+        float q = (value - low) / extent * cells;
+        return (uint32_t)std::min(std::max(q, 0.f), cells - 1.f);
+    }
+
+    void Octree::encode(std::vector<uchar>& buffer, int residualBits, bool entropyCoding) const
+    {
+        CV_Assert(residualBits >= 0 && residualBits <= OCTREE_CODEC_MAX_RESIDUAL_BITS);
+
+        OctreeCodecHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, OCTREE_CODEC_MAGIC, sizeof(header.magic));
+        header.version = OCTREE_CODEC_VERSION;
+        header.maxDepth = maxDepth;
+        header.size = size;
+        header.origin[0] = origin.x;
+        header.origin[1] = origin.y;
+        header.origin[2] = origin.z;
+        header.byteOrder = 1;
+        header.residualBits = (uint8_t)residualBits;
+        header.entropyCoded = entropyCoding ? 1 : 0;
+
+        // Breadth-first, as the decoder rebuilds the nodes. The parent child count is the context of the
+        // occupancy byte of a node: densely occupied regions tend to stay dense.
+        std::vector<const OctreeNode*> nodes;
+        std::vector<uchar> occupancy;
+        std::vector<uchar> contexts;
+        std::vector<uchar> parentChildCounts;
+        std::vector<const OctreeNode*> leaves;
+        if(rootNode != nullptr)
+        {
+            nodes.push_back(rootNode);
+            parentChildCounts.push_back(0);
+        }
+        for(size_t i = 0; i < nodes.size(); i++)
+        {
+            const OctreeNode* node = nodes[i];
+            if(node->isLeaf)
+            {
+                leaves.push_back(node);
+            }
+            if(node->depth >= maxDepth)
+            {
+                continue;
+            }
+
+            uchar mask = 0;
+            if(!node->isLeaf)
+            {
+                for(int childIndex = 0; childIndex < childNum; childIndex++)
+                {
+                    if(node->children[childIndex] != nullptr)
+                    {
+                        mask |= (uchar)(1 << childIndex);
+                    }
+                }
+            }
+            int childCount = popCount8(mask);
+            for(int childIndex = 0; childIndex < childNum; childIndex++)
+            {
+                if(mask & (1 << childIndex))
+                {
+                    nodes.push_back(node->children[childIndex]);
+                    parentChildCounts.push_back((uchar)childCount);
+                }
+            }
+            occupancy.push_back(mask);
+            contexts.push_back(parentChildCounts[i]);
+        }
+
+        std::vector<uchar> counts;
+        uint64_t pointNum = 0;
+        for(const OctreeNode* leaf : leaves)
+        {
+            appendVarint(counts, leafPointCount(leaf));
+            pointNum += leafPointCount(leaf);
+        }
+        header.nodeNum = occupancy.size();
+        header.leafNum = leaves.size();
+        header.pointNum = pointNum;
+
+        buffer.assign(sizeof(header), 0);
+        if(entropyCoding)
+        {
+            RangeByteModel occupancyModels[childNum + 1];
+            RangeByteModel countModel;
+            RangeEncoder encoder(buffer);
+            for(size_t i = 0; i < occupancy.size(); i++)
+            {
+                encoder.encodeByte(occupancyModels[contexts[i]], occupancy[i]);
+            }
+            for(uchar byte : counts)
+            {
+                encoder.encodeByte(countModel, byte);
+            }
+            encoder.flush();
+        }
+        else
+        {
+            buffer.insert(buffer.end(), occupancy.begin(), occupancy.end());
+            buffer.insert(buffer.end(), counts.begin(), counts.end());
+        }
+        header.structureSize = buffer.size() - sizeof(header);
+
+        // The points relative to the cube of their leaf, 3 * residualBits bits each, least significant bit first.
+        size_t residualStart = buffer.size();
+        uint64_t bitBuffer = 0;
+        int bitCount = 0;
+        if(residualBits > 0)
+        {
+            for(const OctreeNode* leaf : leaves)
+            {
+                const float extent = (float)leaf->size;
+                for(size_t j = 0; j < leafPointCount(leaf); j++)
+                {
+                    const Point3f* p = leafPoint(leaf, j);
+                    bitBuffer |= (uint64_t)quantize(p->x, leaf->origin.x, extent, residualBits) << bitCount;
+                    bitBuffer |= (uint64_t)quantize(p->y, leaf->origin.y, extent, residualBits) << (bitCount + residualBits);
+                    bitBuffer |= (uint64_t)quantize(p->z, leaf->origin.z, extent, residualBits) << (bitCount + 2 * residualBits);
+                    bitCount += 3 * residualBits;
+                    while(bitCount >= 8)
+                    {
+                        buffer.push_back((uchar)bitBuffer);
+                        bitBuffer >>= 8;
+                        bitCount -= 8;
+                    }
+                }
+            }
+            if(bitCount > 0)
+            {
+                buffer.push_back((uchar)bitBuffer);
+            }
+        }
+        header.residualSize = buffer.size() - residualStart;
+
+        std::memcpy(buffer.data(), &header, sizeof(header));
+    }
+
+    bool Octree::decode(const std::vector<uchar>& buffer)
+    {
+        return decode(buffer.data(), buffer.size());
+    }
+
+    bool Octree::decode(const uchar* data, size_t dataSize)
+    {
+        clear();
+
+        OctreeCodecHeader header;
+        if(data == nullptr || dataSize < sizeof(header))
+        {
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if(std::memcmp(header.magic, OCTREE_CODEC_MAGIC, sizeof(header.magic)) != 0 ||
+           header.version != OCTREE_CODEC_VERSION || header.byteOrder != 1 ||
+           header.residualBits > OCTREE_CODEC_MAX_RESIDUAL_BITS || header.maxDepth < 0 ||
+           header.maxDepth > MORTON_MAX_DEPTH || header.structureSize > dataSize - sizeof(header) ||
+           header.residualSize > dataSize - sizeof(header) - header.structureSize ||
+           header.pointNum > (uint64_t)std::numeric_limits<int>::max() ||
+           header.residualSize < (header.pointNum * 3 * header.residualBits + 7) / 8)
+        {
+            return false;
+        }
+        // Every occupancy byte and point count takes at least one byte unless range coded, and a range coded
+        // byte takes at least 1/256 of a byte, so the counts cannot be huge without data behind them.
+        const uint64_t maxSymbolNum = header.structureSize * (header.entropyCoded ? 256 : 1) + 256;
+        if(header.nodeNum > maxSymbolNum || header.leafNum > maxSymbolNum)
+        {
+            return false;
+        }
+
+        const uchar* structure = data + sizeof(header);
+        const uchar* residuals = structure + header.structureSize;
+        const bool entropyCoded = header.entropyCoded != 0;
+        RangeDecoder decoder(structure, entropyCoded ? (size_t)header.structureSize : 0);
+        RangeByteModel occupancyModels[childNum + 1];
+        RangeByteModel countModel;
+        size_t structurePos = 0;
+        bool rawOverrun = false;
+        auto overrun = [&]()
+        {
+            return entropyCoded ? decoder.overrun : rawOverrun;
+        };
+        auto nextStructureByte = [&](RangeByteModel& model) -> uchar
+        {
+            if(entropyCoded)
+            {
+                return decoder.decodeByte(model);
+            }
+            if(structurePos < header.structureSize)
+            {
+                return structure[structurePos++];
+            }
+            rawOverrun = true;
+            return 0;
+        };
+
+        maxDepth = header.maxDepth;
+        size = header.size;
+        origin = Point3f(header.origin[0], header.origin[1], header.origin[2]);
+        compact = true;
+
+        if(header.nodeNum == 0 && header.leafNum == 0)
+        {
+            return header.pointNum == 0;
+        }
+
+        // Rebuild the nodes in the order they were written, children are created in child index order.
+        std::vector<OctreeNode*> nodes;
+        std::vector<uchar> parentChildCounts;
+        std::vector<OctreeNode*> leaves;
+        rootNode = getNodePool().allocate(0, size, origin, -1);
+        nodes.push_back(rootNode);
+        parentChildCounts.push_back(0);
+        uint64_t nodeIndex = 0;
+        for(size_t i = 0; i < nodes.size(); i++)
+        {
+            OctreeNode* node = nodes[i];
+            uchar mask = 0;
+            if(node->depth < maxDepth)
+            {
+                if(nodeIndex++ == header.nodeNum || overrun())
+                {
+                    clear();
+                    return false;
+                }
+                mask = nextStructureByte(occupancyModels[parentChildCounts[i]]);
+            }
+            if(mask == 0)
+            {
+                node->isLeaf = true;
+                leaves.push_back(node);
+                continue;
+            }
+
+            int childCount = popCount8(mask);
+            for(int childIndex = 0; childIndex < childNum; childIndex++)
+            {
+                if(mask & (1 << childIndex))
+                {
+                    nodes.push_back(createChild(node, childIndex, *nodePool));
+                    parentChildCounts.push_back((uchar)childCount);
+                }
+            }
+        }
+        if(nodeIndex != header.nodeNum || leaves.size() != header.leafNum)
+        {
+            clear();
+            return false;
+        }
+
+        uint64_t pointNum = 0;
+        for(OctreeNode* leaf : leaves)
+        {
+            uint64_t count = 0;
+            for(int shift = 0; ; shift += 7)
+            {
+                uchar byte = nextStructureByte(countModel);
+                if(shift > 56 || overrun())
+                {
+                    clear();
+                    return false;
+                }
+                count |= (uint64_t)(byte & 0x7F) << shift;
+                if((byte & 0x80) == 0)
+                {
+                    break;
+                }
+            }
+            if(count > header.pointNum - pointNum)
+            {
+                clear();
+                return false;
+            }
+            leaf->pointOffset = (int)pointNum;
+            leaf->pointCount = (int)count;
+            pointNum += count;
+        }
+        if(pointNum != header.pointNum || overrun())
+        {
+            clear();
+            return false;
+        }
+
+        // Without residuals, every point is at the center of its leaf.
+        const int residualBits = header.residualBits;
+        const float cells = (float)(1u << residualBits);
+        compactPoints.resize((size_t)pointNum);
+        compactIndices.resize((size_t)pointNum);
+        uint64_t bitBuffer = 0;
+        int bitCount = 0;
+        size_t residualPos = 0;
+        const uint32_t cellMask = (1u << residualBits) - 1;
+        for(const OctreeNode* leaf : leaves)
+        {
+            const float cellSize = (float)leaf->size / cells;
+            for(int j = 0; j < leaf->pointCount; j++)
+            {
+                while(bitCount < 3 * residualBits)
+                {
+                    bitBuffer |= (uint64_t)residuals[residualPos++] << bitCount;
+                    bitCount += 8;
+                }
+                uint32_t qx = (uint32_t)bitBuffer & cellMask;
+                uint32_t qy = (uint32_t)(bitBuffer >> residualBits) & cellMask;
+                uint32_t qz = (uint32_t)(bitBuffer >> (2 * residualBits)) & cellMask;
+                bitBuffer >>= 3 * residualBits;
+                bitCount -= 3 * residualBits;
+
+                size_t index = (size_t)leaf->pointOffset + j;
+                compactPoints[index] = leaf->origin + Point3f(((float)qx + 0.5f) * cellSize,
+                                                              ((float)qy + 0.5f) * cellSize,
+                                                              ((float)qz + 0.5f) * cellSize);
+                compactIndices[index] = (int)index;
+            }
+        }
+        compactPointData = compactPoints.data();
+        compactIndexData = compactIndices.data();
+        return true;
+    }
+}
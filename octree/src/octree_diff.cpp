@@ -0,0 +1,175 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <cstring>
+#include "octree.h"
+
+namespace cv{
+
+    //! The hash of a single point, from the bits of its coordinates.
+    static uint64 pointHash(const Point3f& point)
+    {
+        // Adding 0 turns -0 into +0, the two compare equal.
+        const float coords[3] = {point.x + 0.f, point.y + 0.f, point.z + 0.f};
+        uint32_t bits[3];
+        std::memcpy(bits, coords, sizeof(bits));
+
+        // The splitmix64 finalizer, applied twice to take the 96 bits in.
+        uint64 h = ((uint64)bits[0] << 32) | bits[1];
+        for(int round = 0; round < 2; round++)
+        {
+            h += 0x9e3779b97f4a7c15ULL;
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+            h ^= h >> 31;
+            h ^= bits[2];
+        }
+        return h;
+    }
+
+    uint64 Octree::getNodeHash(const OctreeNode* node) const
+    {
+        if(node->hash != 0)
+        {
+            return node->hash;
+        }
+
+        // A sum does not depend on the order of the points, nor on how they are split between the children.
+        uint64 hash = 0;
+        if(node->isLeaf)
+        {
+            const size_t pointNum = leafPointCount(node);
+            for(size_t i = 0; i < pointNum; i++)
+            {
+                hash += pointHash(*leafPoint(node, i));
+            }
+        }
+        else
+        {
+            for(const OctreeNode* child : node->children)
+            {
+                if(child != nullptr)
+                {
+                    hash += getNodeHash(child);
+                }
+            }
+        }
+
+        // 0 marks a hash that is not computed.
+        return hash == 0 ? 1 : hash;
+    }
+
+    uint64 Octree::updateHash(OctreeNode* node)
+    {
+        if(node->hash != 0 || node->isLeaf)
+        {
+            node->hash = getNodeHash(node);
+            return node->hash;
+        }
+
+        uint64 hash = 0;
+        for(OctreeNode* child : node->children)
+        {
+            if(child != nullptr)
+            {
+                hash += updateHash(child);
+            }
+        }
+        node->hash = hash == 0 ? 1 : hash;
+        return node->hash;
+    }
+
+    void Octree::updateHashes()
+    {
+        if(rootNode != nullptr)
+        {
+            updateHash(rootNode);
+        }
+    }
+
+    //! Append the leaves of the subtree of node.
+    static void collectLeaves(const OctreeNode* node, std::vector<const OctreeNode*>& leaves)
+    {
+        if(node->isLeaf)
+        {
+            leaves.push_back(node);
+            return;
+        }
+        for(const OctreeNode* child : node->children)
+        {
+            if(child != nullptr)
+            {
+                collectLeaves(child, leaves);
+            }
+        }
+    }
+
+    void Octree::diffRecurse(const Octree& other, const OctreeNode* node, const OctreeNode* otherNode,
+                             std::vector<const OctreeNode*>& addedLeaves, std::vector<const OctreeNode*>& removedLeaves,
+                             std::vector<std::pair<const OctreeNode*, const OctreeNode*> >& changedLeaves) const
+    {
+        if(node == otherNode || getNodeHash(node) == other.getNodeHash(otherNode))
+        {
+            return;
+        }
+
+        if(node->isLeaf || otherNode->isLeaf)
+        {
+            if(node->isLeaf && otherNode->isLeaf)
+            {
+                changedLeaves.push_back(std::make_pair(node, otherNode));
+            }
+            else
+            {
+                collectLeaves(node, removedLeaves);
+                collectLeaves(otherNode, addedLeaves);
+            }
+            return;
+        }
+
+        for(int childIndex = 0; childIndex < childNum; childIndex++)
+        {
+            const OctreeNode* child = node->children[childIndex];
+            const OctreeNode* otherChild = otherNode->children[childIndex];
+            if(child != nullptr && otherChild != nullptr)
+            {
+                diffRecurse(other, child, otherChild, addedLeaves, removedLeaves, changedLeaves);
+            }
+            else if(child != nullptr)
+            {
+                collectLeaves(child, removedLeaves);
+            }
+            else if(otherChild != nullptr)
+            {
+                collectLeaves(otherChild, addedLeaves);
+            }
+        }
+    }
+
+    void Octree::diff(const Octree& other, std::vector<const OctreeNode*>& addedLeaves,
+                      std::vector<const OctreeNode*>& removedLeaves,
+                      std::vector<std::pair<const OctreeNode*, const OctreeNode*> >& changedLeaves) const
+    {
+        if(maxDepth != other.maxDepth || size != other.size || origin != other.origin)
+        {
+            CV_Error(Error::StsBadArg, "The trees to compare must have the same root cube and max depth!");
+        }
+        addedLeaves.clear();
+        removedLeaves.clear();
+        changedLeaves.clear();
+
+        if(rootNode != nullptr && other.rootNode != nullptr)
+        {
+            diffRecurse(other, rootNode, other.rootNode, addedLeaves, removedLeaves, changedLeaves);
+        }
+        else if(rootNode != nullptr)
+        {
+            collectLeaves(rootNode, removedLeaves);
+        }
+        else if(other.rootNode != nullptr)
+        {
+            collectLeaves(other.rootNode, addedLeaves);
+        }
+    }
+}
@@ -0,0 +1,34 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#ifndef OPENCV_OCTREE_OCTREE_DISTANCE_H
+#define OPENCV_OCTREE_OCTREE_DISTANCE_H
+
+#include <algorithm>
+#include "octree.h"
+
+// Distance helpers shared by the queries of the Octree and HashedOctree implementations.
+// Not part of the public API.
+
+namespace cv {
+
+    //! The squared distance between two points.
+    inline float squareDist(const Point3f& a, const Point3f& b)
+    {
+        Point3f diff = a - b;
+        return diff.x * diff.x + diff.y * diff.y + diff.z * diff.z;
+    }
+
+    //! The squared distance from the point to the cube of the node, 0 if the point is inside.
+    inline float squareDistToNode(const Point3f& point, const OctreeNode* node)
+    {
+        float size = (float)node->size;
+        float dx = std::max(std::max(node->origin.x - point.x, point.x - (node->origin.x + size)), 0.f);
+        float dy = std::max(std::max(node->origin.y - point.y, point.y - (node->origin.y + size)), 0.f);
+        float dz = std::max(std::max(node->origin.z - point.z, point.z - (node->origin.z + size)), 0.f);
+        return dx * dx + dy * dy + dz * dz;
+    }
+}
+
+#endif //OPENCV_OCTREE_OCTREE_DISTANCE_H
@@ -0,0 +1,302 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "octree.h"
+#include "mapped_file.h"
+#include "morton.h"
+#include "opencv2/core.hpp"
+
+namespace cv{
+
+    static const char OCTREE_FILE_MAGIC[8] = {'C', 'V', 'O', 'C', 'T', 'R', 'E', 'E'};
+    static const uint32_t OCTREE_FILE_VERSION = 1;
+
+    //! The header of an Octree file. It is followed by the nodes, the leaves, the points and the point indices.
+    struct OctreeFileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        int32_t maxDepth;
+        double size;
+        float origin[3];
+        //! Written as 1, reads differently on a machine with the other byte order.
+        uint32_t byteOrder;
+        uint64_t nodeNum;
+        uint64_t leafNum;
+        uint64_t pointNum;
+    };
+
+    /** @brief A node of an Octree file.
+     * The geometry is not stored: it is recomputed from the parent and the child index exactly the way
+     * the tree computed it when it was built.
+     */
+    struct OctreeFileNode
+    {
+        //! The index of the first child in the node array, the children of a node are contiguous.
+        int32_t firstChild;
+        //! Bit i is set if the node has the child i.
+        uint8_t childMask;
+        uint8_t isLeaf;
+        uint16_t reserved;
+    };
+
+    //! The point range of a leaf in an Octree file, the leaves are stored in node order.
+    struct OctreeFileLeaf
+    {
+        int32_t pointOffset;
+        int32_t pointCount;
+    };
+
+    //! Whether the records of the header fit in dataSize bytes, without forming a product of the untrusted counts.
+    static bool octreeFileFits(const OctreeFileHeader& header, size_t dataSize)
+    {
+        if(dataSize < sizeof(OctreeFileHeader))
+        {
+            return false;
+        }
+        uint64_t remaining = dataSize - sizeof(OctreeFileHeader);
+        if(header.nodeNum > remaining / sizeof(OctreeFileNode))
+        {
+            return false;
+        }
+        remaining -= header.nodeNum * sizeof(OctreeFileNode);
+        if(header.leafNum > remaining / sizeof(OctreeFileLeaf))
+        {
+            return false;
+        }
+        remaining -= header.leafNum * sizeof(OctreeFileLeaf);
+        return header.pointNum <= remaining / (sizeof(Point3f) + sizeof(int));
+    }
+
+    bool Octree::save(const String& path) const
+    {
+        OctreeFileHeader header;
+        std::memcpy(header.magic, OCTREE_FILE_MAGIC, sizeof(header.magic));
+        header.version = OCTREE_FILE_VERSION;
+        header.maxDepth = maxDepth;
+        header.size = size;
+        header.origin[0] = origin.x;
+        header.origin[1] = origin.y;
+        header.origin[2] = origin.z;
+        header.byteOrder = 1;
+
+        // Flatten the tree in breadth-first order, so that the children of every node are contiguous.
+        std::vector<const OctreeNode*> nodes;
+        std::vector<OctreeFileNode> fileNodes;
+        std::vector<OctreeFileLeaf> fileLeaves;
+        std::vector<Point3f> points;
+        std::vector<int> indices;
+        if(rootNode != nullptr)
+        {
+            nodes.push_back(rootNode);
+        }
+        for(size_t i = 0; i < nodes.size(); i++)
+        {
+            const OctreeNode* node = nodes[i];
+            OctreeFileNode fileNode;
+            fileNode.firstChild = (int32_t)nodes.size();
+            fileNode.childMask = 0;
+            fileNode.isLeaf = node->isLeaf ? 1 : 0;
+            fileNode.reserved = 0;
+            for(int childIndex = 0; childIndex < childNum; childIndex++)
+            {
+                if(node->children[childIndex] != nullptr)
+                {
+                    fileNode.childMask |= (uint8_t)(1 << childIndex);
+                    nodes.push_back(node->children[childIndex]);
+                }
+            }
+            fileNodes.push_back(fileNode);
+
+            if(node->isLeaf)
+            {
+                OctreeFileLeaf fileLeaf;
+                fileLeaf.pointOffset = (int32_t)points.size();
+                fileLeaf.pointCount = (int32_t)leafPointCount(node);
+                for(size_t j = 0; j < leafPointCount(node); j++)
+                {
+                    points.push_back(*leafPoint(node, j));
+                    // The points of a non-compact tree become the source point cloud of the loaded tree.
+                    indices.push_back(compact ? compactIndexData[node->pointOffset + j] : (int)indices.size());
+                }
+                fileLeaves.push_back(fileLeaf);
+            }
+        }
+        header.nodeNum = fileNodes.size();
+        header.leafNum = fileLeaves.size();
+        header.pointNum = points.size();
+
+        std::ofstream ofs(path, std::ios::binary);
+        if(!ofs)
+        {
+            return false;
+        }
+        ofs.write((const char*)&header, sizeof(header));
+        ofs.write((const char*)fileNodes.data(), fileNodes.size() * sizeof(OctreeFileNode));
+        ofs.write((const char*)fileLeaves.data(), fileLeaves.size() * sizeof(OctreeFileLeaf));
+        ofs.write((const char*)points.data(), points.size() * sizeof(Point3f));
+        ofs.write((const char*)indices.data(), indices.size() * sizeof(int));
+        return (bool)ofs;
+    }
+
+    bool Octree::load(const String& path, bool mapped)
+    {
+        std::vector<uchar> buffer;
+        Ptr<MappedFile> file;
+        const uchar* data;
+        size_t dataSize;
+        if(mapped)
+        {
+            file = makePtr<MappedFile>();
+            if(!file->open(path))
+            {
+                return false;
+            }
+            data = file->data();
+            dataSize = file->size();
+        }
+        else
+        {
+            std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+            if(!ifs)
+            {
+                return false;
+            }
+            buffer.resize((size_t)ifs.tellg());
+            ifs.seekg(0);
+            ifs.read((char*)buffer.data(), buffer.size());
+            if(!ifs)
+            {
+                return false;
+            }
+            data = buffer.data();
+            dataSize = buffer.size();
+        }
+
+        OctreeFileHeader header;
+        if(dataSize < sizeof(header))
+        {
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if(std::memcmp(header.magic, OCTREE_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+           header.version != OCTREE_FILE_VERSION || header.byteOrder != 1 || header.maxDepth < 0 ||
+           header.maxDepth > MORTON_MAX_DEPTH || !octreeFileFits(header, dataSize))
+        {
+            return false;
+        }
+        // Only an empty tree may have no root cube.
+        if(!std::isfinite(header.size) || header.size < 0 || (header.nodeNum > 0 && header.size == 0) ||
+           !std::isfinite(header.origin[0]) || !std::isfinite(header.origin[1]) || !std::isfinite(header.origin[2]))
+        {
+            return false;
+        }
+
+        const OctreeFileNode* fileNodes = (const OctreeFileNode*)(data + sizeof(header));
+        const OctreeFileLeaf* fileLeaves = (const OctreeFileLeaf*)(fileNodes + header.nodeNum);
+        const Point3f* points = (const Point3f*)(fileLeaves + header.leafNum);
+        const int* indices = (const int*)(points + header.pointNum);
+
+        // Check the whole structure before touching the tree, so that a failed load leaves it unchanged.
+        // Nodes are stored parent first: every node must be reached once, from an earlier node, within maxDepth.
+        std::vector<int> depths(header.nodeNum, -1);
+        if(header.nodeNum > 0)
+        {
+            depths[0] = 0;
+        }
+        size_t leafIndex = 0;
+        for(size_t i = 0; i < header.nodeNum; i++)
+        {
+            const OctreeFileNode& fileNode = fileNodes[i];
+            // A leaf has no children.
+            if(depths[i] < 0 || (fileNode.isLeaf && fileNode.childMask != 0))
+            {
+                return false;
+            }
+
+            if(fileNode.isLeaf)
+            {
+                const OctreeFileLeaf* fileLeaf = leafIndex < header.leafNum ? &fileLeaves[leafIndex] : nullptr;
+                if(fileLeaf == nullptr || fileLeaf->pointOffset < 0 || fileLeaf->pointCount < 0 ||
+                   (uint64_t)fileLeaf->pointOffset + fileLeaf->pointCount > header.pointNum)
+                {
+                    return false;
+                }
+                leafIndex++;
+            }
+
+            size_t childPos = (size_t)fileNode.firstChild;
+            for(int childIndex = 0; childIndex < childNum; childIndex++)
+            {
+                if(fileNode.childMask & (1 << childIndex))
+                {
+                    if(childPos <= i || childPos >= header.nodeNum || depths[childPos] >= 0 ||
+                       depths[i] >= header.maxDepth)
+                    {
+                        return false;
+                    }
+                    depths[childPos++] = depths[i] + 1;
+                }
+            }
+        }
+        if(leafIndex != header.leafNum)
+        {
+            return false;
+        }
+
+        clear();
+        maxDepth = header.maxDepth;
+        size = header.size;
+        origin = Point3f(header.origin[0], header.origin[1], header.origin[2]);
+        compact = true;
+        if(mapped)
+        {
+            mappedFile = file;
+            compactPointData = points;
+            compactIndexData = indices;
+        }
+        else
+        {
+            compactPoints.assign(points, points + header.pointNum);
+            compactIndices.assign(indices, indices + header.pointNum);
+            compactPointData = compactPoints.data();
+            compactIndexData = compactIndices.data();
+        }
+
+        if(header.nodeNum == 0)
+        {
+            return true;
+        }
+
+        std::vector<OctreeNode*> nodes(header.nodeNum, nullptr);
+        nodes[0] = rootNode = getNodePool().allocate(0, size, origin, -1);
+        leafIndex = 0;
+        for(size_t i = 0; i < header.nodeNum; i++)
+        {
+            const OctreeFileNode& fileNode = fileNodes[i];
+            OctreeNode* node = nodes[i];
+            if(fileNode.isLeaf)
+            {
+                const OctreeFileLeaf& fileLeaf = fileLeaves[leafIndex++];
+                node->isLeaf = true;
+                node->pointOffset = fileLeaf.pointOffset;
+                node->pointCount = fileLeaf.pointCount;
+            }
+
+            size_t childPos = (size_t)fileNode.firstChild;
+            for(int childIndex = 0; childIndex < childNum; childIndex++)
+            {
+                if(fileNode.childMask & (1 << childIndex))
+                {
+                    nodes[childPos++] = createChild(node, childIndex, *nodePool);
+                }
+            }
+        }
+        return true;
+    }
+}
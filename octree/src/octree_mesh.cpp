@@ -0,0 +1,110 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <algorithm>
+#include <cmath>
+#include "octree.h"
+
+namespace cv{
+
+    //! The faces of a cube, as quads of corner indices counter-clockwise seen from outside.
+    static const int boxFaces[6][4] =
+    {
+        {0, 4, 6, 2}, {1, 3, 7, 5},
+        {0, 1, 5, 4}, {2, 6, 7, 3},
+        {0, 2, 3, 1}, {4, 5, 7, 6}
+    };
+
+    //! The edges of a cube, between the corners that differ by one bit.
+    static const int boxEdges[12][2] =
+    {
+        {0, 1}, {2, 3}, {4, 5}, {6, 7},
+        {0, 2}, {1, 3}, {4, 6}, {5, 7},
+        {0, 4}, {1, 5}, {2, 6}, {3, 7}
+    };
+
+    void Octree::appendNodeBox(const OctreeNode* node, int mode, std::vector<Point3f>& vertices,
+                               std::vector<int>& indices)
+    {
+        const int first = (int)vertices.size();
+        const float s = (float)node->size;
+        for(int corner = 0; corner < 8; corner++)
+        {
+            vertices.push_back(node->origin + Point3f((corner & 1) ? s : 0.f, (corner & 2) ? s : 0.f,
+                                                      (corner & 4) ? s : 0.f));
+        }
+
+        if(mode == OCTREE_MESH_LINES)
+        {
+            for(int edge = 0; edge < 12; edge++)
+            {
+                indices.push_back(first + boxEdges[edge][0]);
+                indices.push_back(first + boxEdges[edge][1]);
+            }
+            return;
+        }
+
+        for(int face = 0; face < 6; face++)
+        {
+            const int* quad = boxFaces[face];
+            indices.push_back(first + quad[0]);
+            indices.push_back(first + quad[1]);
+            indices.push_back(first + quad[2]);
+            indices.push_back(first + quad[0]);
+            indices.push_back(first + quad[2]);
+            indices.push_back(first + quad[3]);
+        }
+    }
+
+    void Octree::exportNodeBoxes(int depth, std::vector<Point3f>& vertices, std::vector<int>& indices, int mode) const
+    {
+        CV_Assert(mode == OCTREE_MESH_TRIANGLES || mode == OCTREE_MESH_LINES);
+        vertices.clear();
+        indices.clear();
+        if(depth < 0 || depth > maxDepth)
+        {
+            depth = maxDepth;
+        }
+
+        traverseDFS(rootNode, [&](OctreeNode* node)
+        {
+            if(node->depth < depth && !node->isLeaf)
+            {
+                return OCTREE_TRAVERSAL_CONTINUE;
+            }
+            appendNodeBox(node, mode, vertices, indices);
+            return OCTREE_TRAVERSAL_SKIP_CHILDREN;
+        });
+    }
+
+    void Octree::exportNodeBoxes(const Point3f& viewpoint, float focalLength, float maxScreenError,
+                                 std::vector<Point3f>& vertices, std::vector<int>& indices, int mode) const
+    {
+        CV_Assert(mode == OCTREE_MESH_TRIANGLES || mode == OCTREE_MESH_LINES);
+        CV_Assert(focalLength > 0 && maxScreenError > 0);
+        vertices.clear();
+        indices.clear();
+
+        // A cube of size s at distance d covers about s * focalLength / d pixels.
+        const float maxSizeOverDist = maxScreenError / focalLength;
+        traverseDFS(rootNode, [&](OctreeNode* node)
+        {
+            if(!node->isLeaf)
+            {
+                const float s = (float)node->size;
+                const Point3f& o = node->origin;
+                float dx = std::max(std::max(o.x - viewpoint.x, viewpoint.x - (o.x + s)), 0.f);
+                float dy = std::max(std::max(o.y - viewpoint.y, viewpoint.y - (o.y + s)), 0.f);
+                float dz = std::max(std::max(o.z - viewpoint.z, viewpoint.z - (o.z + s)), 0.f);
+                float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+                if(s > maxSizeOverDist * dist)
+                {
+                    return OCTREE_TRAVERSAL_CONTINUE;
+                }
+            }
+            appendNodeBox(node, mode, vertices, indices);
+            return OCTREE_TRAVERSAL_SKIP_CHILDREN;
+        });
+    }
+}
@@ -0,0 +1,270 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "octree.h"
+
+namespace cv{
+
+    /** @brief The parametric traversal of a ray mirrored towards positive coordinates.
+     * Every node is given by the ray parameters where the ray crosses its slabs, [t0, t1) on each axis. The child
+     * index of the mirrored ray is flipped by mirrorMask to get the child index of the tree.
+     */
+    struct RayTraversal
+    {
+        int mirrorMask;
+        double maxT;
+
+        const OctreeNode* visit(const OctreeNode* node, double tx0, double ty0, double tz0,
+                                double tx1, double ty1, double tz1, double& hitT) const
+        {
+            const double tEnter = std::max(std::max(tx0, ty0), tz0);
+            const double tExit = std::min(std::min(tx1, ty1), tz1);
+            if(tExit < 0 || tEnter > tExit || tEnter > maxT)
+            {
+                return nullptr;
+            }
+            if(node->isLeaf)
+            {
+                hitT = std::max(tEnter, 0.0);
+                return node;
+            }
+
+            const double txm = 0.5 * (tx0 + tx1), tym = 0.5 * (ty0 + ty1), tzm = 0.5 * (tz0 + tz1);
+
+            // The first child: on every axis, the upper half if its slab is entered before the node is.
+            int child = (txm < tEnter ? 1 : 0) | (tym < tEnter ? 2 : 0) | (tzm < tEnter ? 4 : 0);
+            while(child < 8)
+            {
+                const double cx0 = (child & 1) ? txm : tx0, cx1 = (child & 1) ? tx1 : txm;
+                const double cy0 = (child & 2) ? tym : ty0, cy1 = (child & 2) ? ty1 : tym;
+                const double cz0 = (child & 4) ? tzm : tz0, cz1 = (child & 4) ? tz1 : tzm;
+                const OctreeNode* next = node->children[child ^ mirrorMask];
+                if(next != nullptr)
+                {
+                    const OctreeNode* hit = visit(next, cx0, cy0, cz0, cx1, cy1, cz1, hitT);
+                    if(hit != nullptr)
+                    {
+                        return hit;
+                    }
+                }
+
+                // Leave through the closest exit plane, towards the upper half of that axis, or out of the node.
+                int axisBit;
+                if(cx1 <= cy1 && cx1 <= cz1)
+                {
+                    axisBit = 1;
+                }
+                else if(cy1 <= cz1)
+                {
+                    axisBit = 2;
+                }
+                else
+                {
+                    axisBit = 4;
+                }
+                child = (child & axisBit) ? 8 : (child | axisBit);
+            }
+            return nullptr;
+        }
+    };
+
+    const OctreeNode* Octree::rayCast(const Point3f& rayOrigin, const Point3f& direction, float& distance,
+                                      float maxDistance) const
+    {
+        distance = std::numeric_limits<float>::infinity();
+        const double length = std::sqrt((double)direction.x * direction.x + (double)direction.y * direction.y +
+                                        (double)direction.z * direction.z);
+        if(rootNode == nullptr || !(length > 0) || maxDistance < 0)
+        {
+            return nullptr;
+        }
+
+        // Mirror the ray about the center of the root cube on the axes where it goes backwards. A null component
+        // gets a tiny positive one, so that the slabs it is parallel to give +-inf rather than NaN.
+        const double low[3] = {origin.x, origin.y, origin.z};
+        const double o[3] = {rayOrigin.x, rayOrigin.y, rayOrigin.z};
+        const double d[3] = {direction.x / length, direction.y / length, direction.z / length};
+        double t0[3], t1[3];
+        RayTraversal traversal;
+        traversal.mirrorMask = 0;
+        traversal.maxT = maxDistance;
+        for(int axis = 0; axis < 3; axis++)
+        {
+            double oa = o[axis], da = d[axis];
+            if(da < 0)
+            {
+                oa = 2 * low[axis] + size - oa;
+                da = -da;
+                traversal.mirrorMask |= 1 << axis;
+            }
+            da = std::max(da, 1e-300);
+            t0[axis] = (low[axis] - oa) / da;
+            t1[axis] = (low[axis] + size - oa) / da;
+        }
+
+        double hitT = 0;
+        const OctreeNode* hit = traversal.visit(rootNode, t0[0], t0[1], t0[2], t1[0], t1[1], t1[2], hitT);
+        if(hit != nullptr)
+        {
+            distance = (float)hitT;
+        }
+        return hit;
+    }
+
+    void Octree::rayCast(const std::vector<Point3f>& rayOrigins, const std::vector<Point3f>& directions,
+                         std::vector<const OctreeNode*>& hits, std::vector<float>& distances, float maxDistance) const
+    {
+        CV_Assert(rayOrigins.size() == directions.size());
+        hits.resize(rayOrigins.size());
+        distances.resize(rayOrigins.size());
+        if(rayOrigins.empty())
+        {
+            return;
+        }
+
+        // Rays are processed in the order given: consecutive rays of a scan or an image visit the same nodes.
+        const int rayNum = (int)rayOrigins.size();
+        const int chunkNum = std::min(std::max(cv::getNumThreads(), 1) * 4, rayNum);
+        parallel_for_(Range(0, chunkNum), [&](const Range& range)
+        {
+            int first = (int)((int64)rayNum * range.start / chunkNum);
+            int last = (int)((int64)rayNum * range.end / chunkNum);
+            for(int i = first; i < last; i++)
+            {
+                hits[i] = rayCast(rayOrigins[i], directions[i], distances[i], maxDistance);
+            }
+        });
+    }
+
+    //! Collect the leaves of node intersecting the planes of active, the planes node is known to be inside are off.
+    template<typename Emit>
+    static void frustumCullRecurse(const OctreeNode* node, const Vec4f* planes, int planeNum, uint32_t active,
+                                   Emit& emit)
+    {
+        const float s = (float)node->size;
+        const Point3f& low = node->origin;
+        for(int i = 0; i < planeNum; i++)
+        {
+            if(!(active & (1u << i)))
+            {
+                continue;
+            }
+
+            // The corner furthest along the plane normal is the most inside one, the opposite corner the least.
+            const Vec4f& plane = planes[i];
+            float px = plane[0] >= 0 ? low.x + s : low.x, nx = plane[0] >= 0 ? low.x : low.x + s;
+            float py = plane[1] >= 0 ? low.y + s : low.y, ny = plane[1] >= 0 ? low.y : low.y + s;
+            float pz = plane[2] >= 0 ? low.z + s : low.z, nz = plane[2] >= 0 ? low.z : low.z + s;
+            if(plane[0] * px + plane[1] * py + plane[2] * pz + plane[3] < 0)
+            {
+                return;
+            }
+            if(plane[0] * nx + plane[1] * ny + plane[2] * nz + plane[3] >= 0)
+            {
+                active &= ~(1u << i);
+            }
+        }
+
+        if(node->isLeaf)
+        {
+            emit(node);
+            return;
+        }
+        for(int childIndex = 0; childIndex < OctreeNode::childNum; childIndex++)
+        {
+            const OctreeNode* child = node->children[childIndex];
+            if(child != nullptr)
+            {
+                frustumCullRecurse(child, planes, planeNum, active, emit);
+            }
+        }
+    }
+
+    void Octree::frustumCull(const std::vector<Vec4f>& planes, std::vector<const OctreeNode*>& leaves) const
+    {
+        CV_Assert(planes.size() <= 32);
+        leaves.clear();
+        if(rootNode == nullptr)
+        {
+            return;
+        }
+
+        const int planeNum = (int)planes.size();
+        auto emit = [&leaves](const OctreeNode* leaf)
+        {
+            leaves.push_back(leaf);
+        };
+        frustumCullRecurse(rootNode, planes.data(), planeNum,
+                           planeNum == 32 ? ~0u : (1u << planeNum) - 1, emit);
+    }
+
+    void Octree::frustumCull(const std::vector<Vec4f>& planes, std::vector<Range>& pointRanges) const
+    {
+        CV_Assert(compact);
+        CV_Assert(planes.size() <= 32);
+        pointRanges.clear();
+        if(rootNode == nullptr)
+        {
+            return;
+        }
+
+        // A leaf starting where the previous range ends extends it.
+        const int planeNum = (int)planes.size();
+        auto emit = [&pointRanges](const OctreeNode* leaf)
+        {
+            if(leaf->pointCount == 0)
+            {
+                return;
+            }
+            if(!pointRanges.empty() && pointRanges.back().end == leaf->pointOffset)
+            {
+                pointRanges.back().end += leaf->pointCount;
+            }
+            else
+            {
+                pointRanges.push_back(Range(leaf->pointOffset, leaf->pointOffset + leaf->pointCount));
+            }
+        };
+        frustumCullRecurse(rootNode, planes.data(), planeNum,
+                           planeNum == 32 ? ~0u : (1u << planeNum) - 1, emit);
+
+        // Loaded and decoded trees store their points breadth-first, their ranges come out of order.
+        std::sort(pointRanges.begin(), pointRanges.end(), [](const Range& a, const Range& b)
+        {
+            return a.start < b.start;
+        });
+        size_t merged = 0;
+        for(size_t i = 1; i < pointRanges.size(); i++)
+        {
+            if(pointRanges[merged].end == pointRanges[i].start)
+            {
+                pointRanges[merged].end = pointRanges[i].end;
+            }
+            else
+            {
+                pointRanges[++merged] = pointRanges[i];
+            }
+        }
+        if(!pointRanges.empty())
+        {
+            pointRanges.resize(merged + 1);
+        }
+    }
+
+    void Octree::frustumCull(const std::vector<std::vector<Vec4f> >& frustums,
+                             std::vector<std::vector<const OctreeNode*> >& leaves) const
+    {
+        leaves.resize(frustums.size());
+        parallel_for_(Range(0, (int)frustums.size()), [&](const Range& range)
+        {
+            for(int i = range.start; i < range.end; i++)
+            {
+                frustumCull(frustums[i], leaves[i]);
+            }
+        });
+    }
+}
@@ -0,0 +1,602 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "ply_reader.h"
+#include "mapped_file.h"
+
+namespace cv{
+
+    namespace
+    {
+        struct HeaderProperty
+        {
+            String name;
+            int typeSize;
+            bool isSigned;
+            bool isFloat;
+            bool isList;
+            //! The type of the list count, for list properties.
+            int countSize;
+            bool countSigned;
+        };
+
+        struct HeaderElement
+        {
+            String name;
+            size_t count;
+            std::vector<HeaderProperty> properties;
+        };
+    }
+
+    static bool parseType(const String& type, int& typeSize, bool& isSigned, bool& isFloat)
+    {
+        isFloat = false;
+        isSigned = true;
+        if(type == "char" || type == "int8")
+        {
+            typeSize = 1;
+        }
+        else if(type == "uchar" || type == "uint8")
+        {
+            typeSize = 1;
+            isSigned = false;
+        }
+        else if(type == "short" || type == "int16")
+        {
+            typeSize = 2;
+        }
+        else if(type == "ushort" || type == "uint16")
+        {
+            typeSize = 2;
+            isSigned = false;
+        }
+        else if(type == "int" || type == "int32")
+        {
+            typeSize = 4;
+        }
+        else if(type == "uint" || type == "uint32")
+        {
+            typeSize = 4;
+            isSigned = false;
+        }
+        else if(type == "float" || type == "float32")
+        {
+            typeSize = 4;
+            isFloat = true;
+        }
+        else if(type == "double" || type == "float64")
+        {
+            typeSize = 8;
+            isFloat = true;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    static void splitTokens(const String& line, std::vector<String>& tokens)
+    {
+        tokens.clear();
+        size_t pos = 0;
+        while(pos < line.size())
+        {
+            while(pos < line.size() && (line[pos] == ' ' || line[pos] == '\t'))
+            {
+                pos++;
+            }
+            size_t end = pos;
+            while(end < line.size() && line[end] != ' ' && line[end] != '\t')
+            {
+                end++;
+            }
+            if(end > pos)
+            {
+                tokens.push_back(line.substr(pos, end - pos));
+            }
+            pos = end;
+        }
+    }
+
+    static inline bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static bool isLittleEndianHost()
+    {
+        const unsigned short one = 1;
+        return *(const uchar*)&one == 1;
+    }
+
+    // Decode a binary scalar of the given type, swapping its bytes if needed.
+    static double decodeScalar(const uchar* data, int typeSize, bool isSigned, bool isFloat, bool swapBytes)
+    {
+        uchar bytes[8];
+        if(swapBytes)
+        {
+            for(int i = 0; i < typeSize; i++)
+            {
+                bytes[i] = data[typeSize - 1 - i];
+            }
+        }
+        else
+        {
+            memcpy(bytes, data, typeSize);
+        }
+
+        switch(typeSize)
+        {
+        case 1:
+            return isSigned ? (double)*(const schar*)bytes : (double)bytes[0];
+        case 2:
+        {
+            ushort v;
+            memcpy(&v, bytes, 2);
+            return isSigned ? (double)(short)v : (double)v;
+        }
+        case 4:
+        {
+            if(isFloat)
+            {
+                float v;
+                memcpy(&v, bytes, 4);
+                return v;
+            }
+            unsigned v;
+            memcpy(&v, bytes, 4);
+            return isSigned ? (double)(int)v : (double)v;
+        }
+        default:
+        {
+            double v;
+            memcpy(&v, bytes, 8);
+            return v;
+        }
+        }
+    }
+
+    // Parse the ascii token at data[pos], bounded by size, and move pos after it.
+    static bool parseAsciiToken(const char* data, size_t size, size_t& pos, float& value)
+    {
+        while(pos < size && isSpace(data[pos]))
+        {
+            pos++;
+        }
+        size_t end = pos;
+        while(end < size && !isSpace(data[end]))
+        {
+            end++;
+        }
+
+        // The mapping is not null-terminated, so the token is copied before strtof.
+        char buffer[64];
+        size_t length = end - pos;
+        if(length == 0 || length >= sizeof(buffer))
+        {
+            return false;
+        }
+        memcpy(buffer, data + pos, length);
+        buffer[length] = '\0';
+
+        char* parsedEnd = nullptr;
+        value = strtof(buffer, &parsedEnd);
+        pos = end;
+        return parsedEnd == buffer + length;
+    }
+
+    PLYReader::PLYReader():format(FORMAT_ASCII), swapBytes(false), vertexCount(0), vertexRead(0), dataOffset(0),
+        vertexStride(0), vertexTokens(0)
+    {
+    }
+
+    PLYReader::~PLYReader()
+    {
+        close();
+    }
+
+    void PLYReader::close()
+    {
+        file.reset();
+        vertexCount = 0;
+        vertexRead = 0;
+        dataOffset = 0;
+        vertexStride = 0;
+        vertexTokens = 0;
+        attributeProperties.clear();
+        attributeNames.clear();
+    }
+
+    bool PLYReader::open(const String& path)
+    {
+        close();
+
+        Ptr<MappedFile> mapped = makePtr<MappedFile>();
+        if(!mapped->open(path))
+        {
+            return false;
+        }
+        const char* data = (const char*)mapped->data();
+        const size_t size = mapped->size();
+
+        // Header, line by line until end_header.
+        size_t pos = 0;
+        String line;
+        std::vector<String> tokens;
+        auto nextLine = [&]() -> bool
+        {
+            if(pos >= size)
+            {
+                return false;
+            }
+            size_t end = pos;
+            while(end < size && data[end] != '\n')
+            {
+                end++;
+            }
+            line.assign(data + pos, end - pos);
+            if(!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            pos = end < size ? end + 1 : end;
+            splitTokens(line, tokens);
+            return true;
+        };
+
+        if(!nextLine() || tokens.size() != 1 || tokens[0] != "ply")
+        {
+            return false;
+        }
+
+        bool hasFormat = false;
+        std::vector<HeaderElement> elements;
+        for(;;)
+        {
+            if(!nextLine())
+            {
+                return false;
+            }
+            if(tokens.empty() || tokens[0] == "comment" || tokens[0] == "obj_info")
+            {
+                continue;
+            }
+            if(tokens[0] == "end_header")
+            {
+                break;
+            }
+
+            if(tokens[0] == "format" && tokens.size() == 3)
+            {
+                if(tokens[1] == "ascii")
+                {
+                    format = FORMAT_ASCII;
+                }
+                else if(tokens[1] == "binary_little_endian")
+                {
+                    format = FORMAT_BINARY_LITTLE_ENDIAN;
+                }
+                else if(tokens[1] == "binary_big_endian")
+                {
+                    format = FORMAT_BINARY_BIG_ENDIAN;
+                }
+                else
+                {
+                    return false;
+                }
+                hasFormat = true;
+            }
+            else if(tokens[0] == "element" && tokens.size() == 3)
+            {
+                HeaderElement element;
+                element.name = tokens[1];
+                char* end = nullptr;
+                element.count = (size_t)strtoull(tokens[2].c_str(), &end, 10);
+                if(*end != '\0')
+                {
+                    return false;
+                }
+                elements.push_back(element);
+            }
+            else if(tokens[0] == "property" && !elements.empty())
+            {
+                HeaderProperty property;
+                property.isList = tokens.size() == 5 && tokens[1] == "list";
+                if(property.isList)
+                {
+                    bool countFloat;
+                    if(!parseType(tokens[2], property.countSize, property.countSigned, countFloat) || countFloat ||
+                       !parseType(tokens[3], property.typeSize, property.isSigned, property.isFloat))
+                    {
+                        return false;
+                    }
+                    property.name = tokens[4];
+                }
+                else
+                {
+                    if(tokens.size() != 3 || !parseType(tokens[1], property.typeSize, property.isSigned, property.isFloat))
+                    {
+                        return false;
+                    }
+                    property.countSize = 0;
+                    property.countSigned = false;
+                    property.name = tokens[2];
+                }
+                elements.back().properties.push_back(property);
+            }
+            else
+            {
+                return false;
+            }
+        }
+        if(!hasFormat)
+        {
+            return false;
+        }
+        swapBytes = format != FORMAT_ASCII && (format == FORMAT_BINARY_LITTLE_ENDIAN) != isLittleEndianHost();
+
+        size_t vertexElement = 0;
+        while(vertexElement < elements.size() && elements[vertexElement].name != "vertex")
+        {
+            vertexElement++;
+        }
+        if(vertexElement == elements.size())
+        {
+            return false;
+        }
+
+        // Skip the elements before the vertices.
+        for(size_t e = 0; e < vertexElement; e++)
+        {
+            const HeaderElement& element = elements[e];
+            if(format == FORMAT_ASCII)
+            {
+                for(size_t i = 0; i < element.count; i++)
+                {
+                    while(pos < size && data[pos] != '\n')
+                    {
+                        pos++;
+                    }
+                    if(pos == size)
+                    {
+                        return false;
+                    }
+                    pos++;
+                }
+                continue;
+            }
+
+            // A binary element without properties takes no byte, whatever its count.
+            for(size_t i = 0; i < element.count && !element.properties.empty(); i++)
+            {
+                for(const HeaderProperty& property : element.properties)
+                {
+                    size_t itemNum = 1;
+                    if(property.isList)
+                    {
+                        if(size - pos < (size_t)property.countSize)
+                        {
+                            return false;
+                        }
+                        double count = decodeScalar((const uchar*)data + pos, property.countSize,
+                                                    property.countSigned, false, swapBytes);
+                        if(count < 0)
+                        {
+                            return false;
+                        }
+                        itemNum = (size_t)count;
+                        pos += property.countSize;
+                    }
+                    if((size - pos) / property.typeSize < itemNum)
+                    {
+                        return false;
+                    }
+                    pos += itemNum * property.typeSize;
+                }
+            }
+        }
+
+        // The vertex layout.
+        const HeaderElement& vertex = elements[vertexElement];
+        int coordFound = 0;
+        size_t offset = 0;
+        for(size_t i = 0; i < vertex.properties.size(); i++)
+        {
+            const HeaderProperty& property = vertex.properties[i];
+            if(property.isList)
+            {
+                return false;
+            }
+
+            Property p;
+            p.typeSize = property.typeSize;
+            p.isSigned = property.isSigned;
+            p.isFloat = property.isFloat;
+            p.offset = format == FORMAT_ASCII ? i : offset;
+            offset += property.typeSize;
+
+            int coord = property.name == "x" ? 0 : property.name == "y" ? 1 : property.name == "z" ? 2 : -1;
+            if(coord >= 0)
+            {
+                if(coordFound & (1 << coord))
+                {
+                    return false;
+                }
+                coordFound |= 1 << coord;
+                coords[coord] = p;
+            }
+            else
+            {
+                attributeProperties.push_back(p);
+                attributeNames.push_back(property.name);
+            }
+        }
+        if(coordFound != 7)
+        {
+            attributeProperties.clear();
+            attributeNames.clear();
+            return false;
+        }
+
+        vertexStride = offset;
+        vertexTokens = vertex.properties.size();
+        // An ascii vertex takes at least one character and one separator per token, the last one may end the file.
+        const size_t vertexMaxCount = format == FORMAT_ASCII ? (size - pos + 1) / (2 * vertexTokens) :
+                                      (size - pos) / vertexStride;
+        if(vertex.count > vertexMaxCount)
+        {
+            attributeProperties.clear();
+            attributeNames.clear();
+            return false;
+        }
+
+        file = mapped;
+        vertexCount = vertex.count;
+        vertexRead = 0;
+        dataOffset = pos;
+        return true;
+    }
+
+    size_t PLYReader::getVertexCount() const
+    {
+        return vertexCount;
+    }
+
+    const std::vector<String>& PLYReader::getAttributeNames() const
+    {
+        return attributeNames;
+    }
+
+    float PLYReader::decodeBinary(const uchar* data, const Property& property) const
+    {
+        return (float)decodeScalar(data + property.offset, property.typeSize, property.isSigned,
+                                   property.isFloat, swapBytes);
+    }
+
+    size_t PLYReader::read(Point3f* points, float* attributes, size_t maxCount)
+    {
+        if(!file || vertexRead >= vertexCount || maxCount == 0)
+        {
+            return 0;
+        }
+        CV_Assert(points != nullptr);
+
+        return format == FORMAT_ASCII ? readAscii(points, attributes, maxCount) :
+               readBinary(points, attributes, maxCount);
+    }
+
+    bool PLYReader::read(std::vector<Point3f>& points, std::vector<float>* attributes)
+    {
+        const size_t remaining = vertexCount - vertexRead;
+        const size_t attributeNum = attributeNames.size();
+        points.resize(remaining);
+        if(attributes)
+        {
+            attributes->resize(remaining * attributeNum);
+        }
+        if(remaining == 0)
+        {
+            return (bool)file;
+        }
+
+        size_t readNum = read(points.data(), attributes && attributeNum ? attributes->data() : nullptr, remaining);
+        if(readNum < remaining)
+        {
+            points.resize(readNum);
+            if(attributes)
+            {
+                attributes->resize(readNum * attributeNum);
+            }
+            return false;
+        }
+        return true;
+    }
+
+    size_t PLYReader::readBinary(Point3f* points, float* attributes, size_t maxCount)
+    {
+        const size_t pointNum = std::min(maxCount, vertexCount - vertexRead);
+        const uchar* base = file->data() + dataOffset;
+        const size_t attributeNum = attributeProperties.size();
+
+        // Vertices have a fixed size, so chunks of them decode independently.
+        const bool plainFloat = !swapBytes && coords[0].isFloat && coords[0].typeSize == 4 &&
+                                coords[1].isFloat && coords[1].typeSize == 4 &&
+                                coords[2].isFloat && coords[2].typeSize == 4;
+        const int chunkNum = (int)std::min<size_t>((size_t)getNumThreads() * 4, (pointNum + 1023) / 1024);
+        parallel_for_(Range(0, chunkNum), [&](const Range& range)
+        {
+            for(int chunk = range.start; chunk < range.end; chunk++)
+            {
+                size_t begin = pointNum * chunk / chunkNum;
+                size_t end = pointNum * (chunk + 1) / chunkNum;
+                for(size_t i = begin; i < end; i++)
+                {
+                    const uchar* vertex = base + i * vertexStride;
+                    if(plainFloat)
+                    {
+                        memcpy(&points[i].x, vertex + coords[0].offset, sizeof(float));
+                        memcpy(&points[i].y, vertex + coords[1].offset, sizeof(float));
+                        memcpy(&points[i].z, vertex + coords[2].offset, sizeof(float));
+                    }
+                    else
+                    {
+                        points[i] = Point3f(decodeBinary(vertex, coords[0]), decodeBinary(vertex, coords[1]),
+                                            decodeBinary(vertex, coords[2]));
+                    }
+                    if(attributes)
+                    {
+                        for(size_t a = 0; a < attributeNum; a++)
+                        {
+                            attributes[i * attributeNum + a] = decodeBinary(vertex, attributeProperties[a]);
+                        }
+                    }
+                }
+            }
+        });
+
+        vertexRead += pointNum;
+        dataOffset += pointNum * vertexStride;
+        return pointNum;
+    }
+
+    size_t PLYReader::readAscii(Point3f* points, float* attributes, size_t maxCount)
+    {
+        const size_t pointNum = std::min(maxCount, vertexCount - vertexRead);
+        const char* data = (const char*)file->data();
+        const size_t size = file->size();
+        const size_t attributeNum = attributeProperties.size();
+
+        // The tokens of a vertex, in file order, then scattered to the coordinates and attributes.
+        std::vector<float> values(vertexTokens);
+        size_t pos = dataOffset;
+        for(size_t i = 0; i < pointNum; i++)
+        {
+            for(size_t t = 0; t < vertexTokens; t++)
+            {
+                if(!parseAsciiToken(data, size, pos, values[t]))
+                {
+                    // Stop at the malformed vertex, the following ones can't be located.
+                    vertexRead = vertexCount;
+                    return i;
+                }
+            }
+            points[i] = Point3f(values[coords[0].offset], values[coords[1].offset], values[coords[2].offset]);
+            if(attributes)
+            {
+                for(size_t a = 0; a < attributeNum; a++)
+                {
+                    attributes[i * attributeNum + a] = values[attributeProperties[a].offset];
+                }
+            }
+        }
+
+        vertexRead += pointNum;
+        dataOffset = pos;
+        return pointNum;
+    }
+}
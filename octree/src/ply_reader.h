@@ -0,0 +1,114 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#ifndef OPENCV_OCTREE_PLY_READER_H
+#define OPENCV_OCTREE_PLY_READER_H
+
+#include <vector>
+#include "opencv2/core.hpp"
+
+namespace cv {
+
+    class MappedFile;
+
+    /** @brief Reader for the vertices of PLY files.
+
+    The header is parsed to locate the x, y and z properties of the vertex element, whatever their type and
+    position, and the format may be ascii, binary_little_endian or binary_big_endian. The file is memory mapped
+    and decoded directly into the output buffers: binary vertices are decoded in parallel, ascii vertices are
+    parsed without iostream. The other scalar properties of the vertices, such as confidence or intensity,
+    can be read along as attributes. Elements before the vertices are skipped, the ones after are ignored.
+
+    The vertices can be read all at once, or in chunks, for example to hand them over to an Octree while
+    the rest of the file is still being decoded.
+    */
+    class CV_EXPORTS PLYReader{
+    public:
+
+        PLYReader();
+
+        //! destructor - calls close()
+        ~PLYReader();
+
+        PLYReader(const PLYReader&) = delete;
+        PLYReader& operator=(const PLYReader&) = delete;
+
+        /** @brief Open a PLY file and parse its header.
+         * @param path The path of the file.
+         * @return Returns whether the file is a PLY file with x, y and z vertex properties.
+         */
+        bool open(const String& path);
+
+        //! Close the file.
+        void close();
+
+        //! The number of vertices in the file.
+        size_t getVertexCount() const;
+
+        //! The names of the scalar vertex properties other than x, y and z, in file order.
+        const std::vector<String>& getAttributeNames() const;
+
+        /** @brief Read the next chunk of vertices.
+         * @param points Output, at least maxCount points.
+         * @param attributes Output, at least maxCount * getAttributeNames().size() values, the attributes of the
+         * i-th point are stored from i * getAttributeNames().size(). May be NULL.
+         * @param maxCount The maximum number of vertices to read.
+         * @return The number of vertices read, 0 at the end of the vertices or on a parsing error.
+         */
+        size_t read(Point3f* points, float* attributes, size_t maxCount);
+
+        /** @overload
+         * @brief Read all the remaining vertices.
+         * @param points Output, resized to the number of remaining vertices. Its capacity is reused.
+         * @param attributes Optional output, resized and laid out as above.
+         * @return Returns whether all the vertices were read.
+         */
+        bool read(std::vector<Point3f>& points, std::vector<float>* attributes = nullptr);
+
+    private:
+
+        enum Format
+        {
+            FORMAT_ASCII,
+            FORMAT_BINARY_LITTLE_ENDIAN,
+            FORMAT_BINARY_BIG_ENDIAN
+        };
+
+        //! A scalar vertex property.
+        struct Property
+        {
+            //! The PLY type, as its size in bytes, signedness and float-ness.
+            int typeSize;
+            bool isSigned;
+            bool isFloat;
+            //! The byte offset in a binary vertex, or the token index in an ascii vertex line.
+            size_t offset;
+        };
+
+        //! Decode a binary scalar of the given property at data.
+        float decodeBinary(const uchar* data, const Property& property) const;
+
+        size_t readBinary(Point3f* points, float* attributes, size_t maxCount);
+        size_t readAscii(Point3f* points, float* attributes, size_t maxCount);
+
+        Ptr<MappedFile> file;
+        Format format;
+        //! Whether the binary scalars have the opposite byte order to the host.
+        bool swapBytes;
+        size_t vertexCount;
+        //! The vertices already read.
+        size_t vertexRead;
+        //! The position of the next vertex in the file.
+        size_t dataOffset;
+        //! The size of a binary vertex.
+        size_t vertexStride;
+        //! The number of tokens in an ascii vertex line.
+        size_t vertexTokens;
+        Property coords[3];
+        std::vector<Property> attributeProperties;
+        std::vector<String> attributeNames;
+    };
+}
+
+#endif //OPENCV_OCTREE_PLY_READER_H